@@ -0,0 +1,634 @@
+#ifndef BPLUSTREE_H
+#define BPLUSTREE_H
+
+#include "Tree.h"
+#include "Pool.h"
+
+/**
+ * @brief A cache-conscious B+ tree with the same contract as Tree.
+ *
+ * It also has the point-lookup interface of HashIndex, so either can serve
+ * a role that only finds, inserts and removes by id.
+ *
+ * Keys are the int ids of the stored handles, kept in contiguous arrays
+ * so a node is searched within a few cache lines, and the tree is only
+ * a handful of levels deep. Values live in the leaves only.
+ *
+ * Unlike Tree, entries move between leaves on splits and merges: a
+ * pointer returned by tryFind() is valid only until the next insert or
+ * remove.
+ *
+ * @tparam T The type of the handles stored in the tree, int(*handle) is
+ * the key.
+ * @tparam Alloc The node allocator policy, HeapAllocator or PoolAllocator.
+ * @tparam Fanout Children per inner node and entries per leaf.
+ */
+template <typename T, template <typename> class Alloc = HeapAllocator, int Fanout = 32>
+class BPlusTree
+{
+private:
+    static_assert(Fanout >= 4, "B+ tree nodes need room to split");
+
+    static const int LEAF_CAPACITY = Fanout;
+    static const int LEAF_MIN = LEAF_CAPACITY / 2;
+    static const int INNER_CAPACITY = Fanout - 1; // keys, children are one more.
+    static const int INNER_MIN = INNER_CAPACITY / 2;
+    // Far beyond the depth of any tree that fits in memory.
+    static const int MAX_DEPTH = 32;
+
+    struct Leaf {
+        int count;
+        int keys[LEAF_CAPACITY];
+        T values[LEAF_CAPACITY];
+
+        Leaf() : count(0) {}
+    };
+
+    struct Inner {
+        int count; // number of keys, children has count + 1 entries.
+        int keys[INNER_CAPACITY];
+        void* children[INNER_CAPACITY + 1];
+
+        Inner() : count(0) {}
+    };
+
+    typedef Alloc<Leaf> LeafAllocator;
+    typedef Alloc<Inner> InnerAllocator;
+
+    // Levels of the tree, 0 when empty and 1 when the root is a leaf.
+    void* root;
+    int height;
+    int count;
+
+    static int keyOf(const T& value) {
+        return static_cast<int>(*value);
+    }
+
+    // Index of the first key that is not less than key.
+    static int lowerBound(const int* keys, const int count, const int key) {
+        int low = 0;
+        int high = count;
+        while (low < high) {
+            const int mid = (low + high) / 2;
+            if (keys[mid] < key) {
+                low = mid + 1;
+            } else {
+                high = mid;
+            }
+        }
+        return low;
+    }
+
+    // Child of an inner node that may hold key: keys equal to a separator
+    // belong to its right.
+    static int childIndex(const Inner* inner, const int key) {
+        int low = 0;
+        int high = inner->count;
+        while (low < high) {
+            const int mid = (low + high) / 2;
+            if (inner->keys[mid] <= key) {
+                low = mid + 1;
+            } else {
+                high = mid;
+            }
+        }
+        return low;
+    }
+
+    Leaf* findLeaf(const int key) const {
+        void* node = root;
+        for (int level = height; level > 1; --level) {
+            Inner* inner = static_cast<Inner*>(node);
+            node = inner->children[childIndex(inner, key)];
+        }
+        return static_cast<Leaf*>(node);
+    }
+
+    // Insertion:
+
+    /**
+     * @brief Insert a separator and its right child into an inner node,
+     * splitting the node if it is full.
+     *
+     * @param inner The inner node.
+     * @param position Where the separator goes among the keys.
+     * @param key The separator.
+     * @param child The child to its right.
+     * @param spare An allocated empty node, which becomes the right sibling
+     * if the node splits.
+     * @param promoted Set to the separator for the parent if a split happened.
+     * @return The new right sibling, or nullptr if no split was needed.
+     */
+    Inner* insertIntoInner(Inner* inner, const int position, const int key,
+                           void* child, Inner* spare, int& promoted) {
+        if (inner->count < INNER_CAPACITY) {
+            for (int i = inner->count; i > position; --i) {
+                inner->keys[i] = inner->keys[i - 1];
+                inner->children[i + 1] = inner->children[i];
+            }
+            inner->keys[position] = key;
+            inner->children[position + 1] = child;
+            inner->count++;
+            return nullptr;
+        }
+
+        // Full: lay out all keys in scratch arrays and split around the middle.
+        int keys[INNER_CAPACITY + 1];
+        void* children[INNER_CAPACITY + 2];
+        children[0] = inner->children[0];
+        for (int i = 0, j = 0; i <= INNER_CAPACITY; ++i) {
+            if (i == position) {
+                keys[i] = key;
+                children[i + 1] = child;
+            } else {
+                keys[i] = inner->keys[j];
+                children[i + 1] = inner->children[j + 1];
+                ++j;
+            }
+        }
+
+        Inner* sibling = spare;
+        const int total = INNER_CAPACITY + 1;
+        const int leftCount = total / 2;
+        promoted = keys[leftCount];
+
+        inner->count = leftCount;
+        for (int i = 0; i < leftCount; ++i) {
+            inner->keys[i] = keys[i];
+            inner->children[i] = children[i];
+        }
+        inner->children[leftCount] = children[leftCount];
+
+        sibling->count = total - leftCount - 1;
+        for (int i = 0; i < sibling->count; ++i) {
+            sibling->keys[i] = keys[leftCount + 1 + i];
+            sibling->children[i] = children[leftCount + 1 + i];
+        }
+        sibling->children[sibling->count] = children[total];
+        return sibling;
+    }
+
+    // Insert into a leaf at position, which must not be full.
+    static void insertIntoLeaf(Leaf* leaf, const int position, const T& value) {
+        for (int i = leaf->count; i > position; --i) {
+            leaf->keys[i] = leaf->keys[i - 1];
+            leaf->values[i] = leaf->values[i - 1];
+        }
+        leaf->keys[position] = keyOf(value);
+        leaf->values[position] = value;
+        leaf->count++;
+    }
+
+    // Deletion:
+
+    static void removeFromLeaf(Leaf* leaf, const int position) {
+        for (int i = position + 1; i < leaf->count; ++i) {
+            leaf->keys[i - 1] = leaf->keys[i];
+            leaf->values[i - 1] = leaf->values[i];
+        }
+        leaf->count--;
+    }
+
+    // Remove the separator at position and the child to its right.
+    static void removeFromInner(Inner* inner, const int position) {
+        for (int i = position + 1; i < inner->count; ++i) {
+            inner->keys[i - 1] = inner->keys[i];
+            inner->children[i] = inner->children[i + 1];
+        }
+        inner->count--;
+    }
+
+    /**
+     * @brief Fix an underfull leaf by borrowing from or merging with a sibling.
+     *
+     * @param parent The parent of the leaf.
+     * @param index The index of the leaf among the parent's children.
+     */
+    void fixLeaf(Inner* parent, const int index) {
+        Leaf* leaf = static_cast<Leaf*>(parent->children[index]);
+        Leaf* left = index > 0 ? static_cast<Leaf*>(parent->children[index - 1]) : nullptr;
+        Leaf* right = index < parent->count ?
+            static_cast<Leaf*>(parent->children[index + 1]) : nullptr;
+
+        if (left != nullptr && left->count > LEAF_MIN) {
+            // Borrow the largest entry of the left sibling.
+            insertIntoLeaf(leaf, 0, left->values[left->count - 1]);
+            left->count--;
+            parent->keys[index - 1] = leaf->keys[0];
+        } else if (right != nullptr && right->count > LEAF_MIN) {
+            // Borrow the smallest entry of the right sibling.
+            insertIntoLeaf(leaf, leaf->count, right->values[0]);
+            removeFromLeaf(right, 0);
+            parent->keys[index] = right->keys[0];
+        } else if (left != nullptr) {
+            mergeLeaves(parent, index - 1);
+        } else {
+            mergeLeaves(parent, index);
+        }
+    }
+
+    // Merge the leaf right of separator position into the one on its left.
+    void mergeLeaves(Inner* parent, const int position) {
+        Leaf* left = static_cast<Leaf*>(parent->children[position]);
+        Leaf* right = static_cast<Leaf*>(parent->children[position + 1]);
+        for (int i = 0; i < right->count; ++i) {
+            left->keys[left->count + i] = right->keys[i];
+            left->values[left->count + i] = right->values[i];
+        }
+        left->count += right->count;
+        removeFromInner(parent, position);
+        LeafAllocator::destroy(right);
+    }
+
+    /**
+     * @brief Fix an underfull inner node by rotating a key through the
+     * parent or merging with a sibling.
+     *
+     * @param parent The parent of the inner node.
+     * @param index The index of the node among the parent's children.
+     */
+    void fixInner(Inner* parent, const int index) {
+        Inner* inner = static_cast<Inner*>(parent->children[index]);
+        Inner* left = index > 0 ? static_cast<Inner*>(parent->children[index - 1]) : nullptr;
+        Inner* right = index < parent->count ?
+            static_cast<Inner*>(parent->children[index + 1]) : nullptr;
+
+        if (left != nullptr && left->count > INNER_MIN) {
+            // The left sibling's last child moves over, its separator goes up.
+            inner->children[inner->count + 1] = inner->children[inner->count];
+            for (int i = inner->count; i > 0; --i) {
+                inner->keys[i] = inner->keys[i - 1];
+                inner->children[i] = inner->children[i - 1];
+            }
+            inner->keys[0] = parent->keys[index - 1];
+            inner->children[0] = left->children[left->count];
+            inner->count++;
+            parent->keys[index - 1] = left->keys[left->count - 1];
+            left->count--;
+        } else if (right != nullptr && right->count > INNER_MIN) {
+            // The right sibling's first child moves over, its separator goes up.
+            inner->keys[inner->count] = parent->keys[index];
+            inner->children[inner->count + 1] = right->children[0];
+            inner->count++;
+            parent->keys[index] = right->keys[0];
+            for (int i = 1; i < right->count; ++i) {
+                right->keys[i - 1] = right->keys[i];
+            }
+            for (int i = 1; i <= right->count; ++i) {
+                right->children[i - 1] = right->children[i];
+            }
+            right->count--;
+        } else if (left != nullptr) {
+            mergeInners(parent, index - 1);
+        } else {
+            mergeInners(parent, index);
+        }
+    }
+
+    // Merge the inner node right of separator position into the one on its
+    // left, pulling the separator down between them.
+    void mergeInners(Inner* parent, const int position) {
+        Inner* left = static_cast<Inner*>(parent->children[position]);
+        Inner* right = static_cast<Inner*>(parent->children[position + 1]);
+        left->keys[left->count] = parent->keys[position];
+        for (int i = 0; i < right->count; ++i) {
+            left->keys[left->count + 1 + i] = right->keys[i];
+        }
+        for (int i = 0; i <= right->count; ++i) {
+            left->children[left->count + 1 + i] = right->children[i];
+        }
+        left->count += 1 + right->count;
+        removeFromInner(parent, position);
+        InnerAllocator::destroy(right);
+    }
+
+    // Destroy the subtree at the given level, handing every value to dispose.
+    // Recursion depth is the tree height, a handful of levels.
+    template <typename Dispose>
+    void destroyTree(void* node, const int level, Dispose& dispose) {
+        if (level == 1) {
+            Leaf* leaf = static_cast<Leaf*>(node);
+            for (int i = 0; i < leaf->count; ++i) {
+                dispose(leaf->values[i]);
+            }
+            LeafAllocator::destroy(leaf);
+            return;
+        }
+        Inner* inner = static_cast<Inner*>(node);
+        for (int i = 0; i <= inner->count; ++i) {
+            destroyTree(inner->children[i], level - 1, dispose);
+        }
+        InnerAllocator::destroy(inner);
+    }
+
+    template <typename F>
+    static void visit(const void* node, const int level, F& f) {
+        if (level == 1) {
+            const Leaf* leaf = static_cast<const Leaf*>(node);
+            for (int i = 0; i < leaf->count; ++i) {
+                f(leaf->values[i]);
+            }
+            return;
+        }
+        const Inner* inner = static_cast<const Inner*>(node);
+        for (int i = 0; i <= inner->count; ++i) {
+            visit(inner->children[i], level - 1, f);
+        }
+    }
+
+    struct KeepKey {
+        void operator()(const T&) const {}
+    };
+
+public:
+    // Constructor:
+    BPlusTree() : root(nullptr), height(0), count(0) {}
+
+    BPlusTree(const BPlusTree&) = delete;
+    BPlusTree& operator=(const BPlusTree&) = delete;
+
+    // Destructor:
+    ~BPlusTree() {
+        KeepKey keep;
+        clear(keep);
+    }
+
+    /**
+     * @brief Public insert method.
+     *
+     * @param key The key to insert.
+     * @throws KeyExistsException if the key already exists in the tree.
+     */
+    void insert(const T& key) {
+        if (tryInsert(key) != TreeResult::SUCCESS) {
+            throw KeyExistsException();
+        }
+    }
+
+    /**
+     * @brief Public remove method.
+     *
+     * @param key The key to remove.
+     * @throws KeyNotFoundException if the key is not found in the tree.
+     */
+    void remove(const int key) {
+        if (tryRemove(key) != TreeResult::SUCCESS) {
+            throw KeyNotFoundException();
+        }
+    }
+
+    /**
+     * @brief Public find method.
+     *
+     * @param key The key to find.
+     * @return Reference to the value stored in the tree.
+     * @throws KeyNotFoundException if the key is not found in the tree.
+     */
+    T& find(const int& key) const {
+        T* found = tryFind(key);
+        if (found == nullptr) {
+            throw KeyNotFoundException();
+        }
+        return *found;
+    }
+
+    /**
+     * @brief Insert a value without throwing on duplicates.
+     *
+     * @param value The value to insert, keyed by int(*value).
+     * @return SUCCESS, or KEY_EXISTS if the key is already in the tree.
+     * @throws std::bad_alloc with the tree unchanged.
+     */
+    TreeResult tryInsert(const T& value) {
+        const int key = keyOf(value);
+        if (root == nullptr) {
+            Leaf* leaf = LeafAllocator::create();
+            insertIntoLeaf(leaf, 0, value);
+            root = leaf;
+            height = 1;
+            count = 1;
+            return TreeResult::SUCCESS;
+        }
+
+        // Descend, remembering the inner nodes and the child taken in each.
+        Inner* path[MAX_DEPTH];
+        int indices[MAX_DEPTH];
+        int depth = 0;
+        void* node = root;
+        for (int level = height; level > 1; --level) {
+            Inner* inner = static_cast<Inner*>(node);
+            path[depth] = inner;
+            indices[depth] = childIndex(inner, key);
+            node = inner->children[indices[depth]];
+            ++depth;
+        }
+
+        Leaf* leaf = static_cast<Leaf*>(node);
+        const int position = lowerBound(leaf->keys, leaf->count, key);
+        if (position < leaf->count && leaf->keys[position] == key) {
+            return TreeResult::KEY_EXISTS;
+        }
+        if (leaf->count < LEAF_CAPACITY) {
+            insertIntoLeaf(leaf, position, value);
+            count++;
+            return TreeResult::SUCCESS;
+        }
+
+        // Allocate every node the split needs before changing anything: the
+        // leaf's sibling, one sibling per full inner node the split climbs
+        // through and a new root if it climbs out of the root.
+        int innerSplits = 0;
+        while (innerSplits < depth && path[depth - 1 - innerSplits]->count == INNER_CAPACITY) {
+            ++innerSplits;
+        }
+        const int innerNeeded = innerSplits == depth ? innerSplits + 1 : innerSplits;
+        Inner* spares[MAX_DEPTH + 1];
+        int allocated = 0;
+        Leaf* sibling;
+        try {
+            for (; allocated < innerNeeded; ++allocated) {
+                spares[allocated] = InnerAllocator::create();
+            }
+            sibling = LeafAllocator::create();
+        } catch (std::bad_alloc&) {
+            for (int i = 0; i < allocated; ++i) {
+                InnerAllocator::destroy(spares[i]);
+            }
+            throw;
+        }
+        count++;
+
+        // Split the full leaf in half, then insert into the proper half.
+        const int leftCount = LEAF_CAPACITY / 2;
+        sibling->count = LEAF_CAPACITY - leftCount;
+        for (int i = 0; i < sibling->count; ++i) {
+            sibling->keys[i] = leaf->keys[leftCount + i];
+            sibling->values[i] = leaf->values[leftCount + i];
+        }
+        leaf->count = leftCount;
+        if (position <= leftCount) {
+            insertIntoLeaf(leaf, position, value);
+        } else {
+            insertIntoLeaf(sibling, position - leftCount, value);
+        }
+
+        // Push separators up while nodes keep splitting.
+        int separator = sibling->keys[0];
+        void* child = sibling;
+        int used = 0;
+        while (depth > 0) {
+            --depth;
+            int promoted = 0;
+            Inner* spare = used < innerNeeded ? spares[used] : nullptr;
+            Inner* split = insertIntoInner(path[depth], indices[depth], separator,
+                                           child, spare, promoted);
+            if (split == nullptr) {
+                return TreeResult::SUCCESS;
+            }
+            ++used;
+            separator = promoted;
+            child = split;
+        }
+
+        // The root itself split, grow a new root above it.
+        Inner* newRoot = spares[used];
+        newRoot->count = 1;
+        newRoot->keys[0] = separator;
+        newRoot->children[0] = root;
+        newRoot->children[1] = child;
+        root = newRoot;
+        height++;
+        return TreeResult::SUCCESS;
+    }
+
+    /**
+     * @brief Remove a key without throwing if it is missing.
+     *
+     * @param key The key to remove.
+     * @return SUCCESS, or KEY_NOT_FOUND if the key is not in the tree.
+     */
+    TreeResult tryRemove(const int key) {
+        if (root == nullptr) {
+            return TreeResult::KEY_NOT_FOUND;
+        }
+
+        Inner* path[MAX_DEPTH];
+        int indices[MAX_DEPTH];
+        int depth = 0;
+        void* node = root;
+        for (int level = height; level > 1; --level) {
+            Inner* inner = static_cast<Inner*>(node);
+            path[depth] = inner;
+            indices[depth] = childIndex(inner, key);
+            node = inner->children[indices[depth]];
+            ++depth;
+        }
+
+        Leaf* leaf = static_cast<Leaf*>(node);
+        const int position = lowerBound(leaf->keys, leaf->count, key);
+        if (position == leaf->count || leaf->keys[position] != key) {
+            return TreeResult::KEY_NOT_FOUND;
+        }
+        removeFromLeaf(leaf, position);
+        count--;
+
+        if (depth == 0) {
+            // The root leaf may shrink down to nothing.
+            if (leaf->count == 0) {
+                LeafAllocator::destroy(leaf);
+                root = nullptr;
+                height = 0;
+            }
+            return TreeResult::SUCCESS;
+        }
+        if (leaf->count >= LEAF_MIN) {
+            return TreeResult::SUCCESS;
+        }
+
+        // Fix underflows bottom-up, each fix may leave the parent underfull.
+        fixLeaf(path[depth - 1], indices[depth - 1]);
+        for (--depth; depth > 0; --depth) {
+            if (path[depth]->count >= INNER_MIN) {
+                return TreeResult::SUCCESS;
+            }
+            fixInner(path[depth - 1], indices[depth - 1]);
+        }
+
+        // An inner root left with a single child hands the root down.
+        Inner* top = static_cast<Inner*>(root);
+        if (top->count == 0) {
+            root = top->children[0];
+            height--;
+            InnerAllocator::destroy(top);
+        }
+        return TreeResult::SUCCESS;
+    }
+
+    /**
+     * @brief Find a key without throwing if it is missing.
+     *
+     * @param key The key to find.
+     * @return Pointer to the value stored in the tree, or nullptr if not
+     * found. Valid until the next insert or remove.
+     */
+    T* tryFind(const int& key) const {
+        if (root == nullptr) {
+            return nullptr;
+        }
+        Leaf* leaf = findLeaf(key);
+        const int position = lowerBound(leaf->keys, leaf->count, key);
+        if (position < leaf->count && leaf->keys[position] == key) {
+            return &leaf->values[position];
+        }
+        return nullptr;
+    }
+
+    /**
+     * @brief Remove all keys from the tree.
+     *
+     * @param dispose Called on every value before its leaf is freed.
+     */
+    template <typename Dispose>
+    void clear(Dispose dispose) {
+        if (root != nullptr) {
+            destroyTree(root, height, dispose);
+        }
+        root = nullptr;
+        height = 0;
+        count = 0;
+    }
+
+    /**
+     * @brief Call f on every value, in key order.
+     */
+    template <typename F>
+    void forEach(F f) const {
+        if (root != nullptr) {
+            visit(root, height, f);
+        }
+    }
+
+    /**
+     * @brief Does nothing, a tree allocates a node at a time. Lets the tree
+     * stand in for a HashIndex.
+     */
+    void reserve(int) {}
+
+    /**
+     * @brief Number of keys in the tree, O(1).
+     */
+    int size() const {
+        return count;
+    }
+
+    /**
+     * @brief Check if the tree is empty.
+     *
+     * @return true if the tree is empty, false otherwise.
+     */
+    bool isEmpty() const {
+        return root == nullptr;
+    }
+};
+
+#endif //BPLUSTREE_H
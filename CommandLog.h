@@ -0,0 +1,291 @@
+#ifndef COMMANDLOG_H
+#define COMMANDLOG_H
+
+#include "TechSystem26a1.h"
+
+/**
+ * @brief Compact binary encoding of TechSystem commands and their results.
+ *
+ * A command log starts with the 4 bytes of commandMagic() and holds one record
+ * per command: the opcode in one byte, followed by its arguments as
+ * varints. Student and course ids are stored as the zigzag-encoded
+ * difference from the previous student or course id in the log, so the
+ * clustered ids of a real trace mostly take one or two bytes. Points are
+ * stored zigzag-encoded as they are, the awardPoints flag of
+ * FORCE_REMOVE_COURSE as a 0 or 1 byte.
+ *
+ * A result log starts with resultMagic() and holds one record per command:
+ * the status in one byte, followed by the answer as a zigzag varint for a
+ * successful GET_STUDENT_POINTS.
+ *
+ * The encoder and decoder work on caller buffers and never allocate. Each
+ * keeps the previous ids, so a log must be decoded from its start with
+ * the same kind of object that encoded it.
+ */
+class CommandLog
+{
+public:
+    static const int MAGIC_SIZE = 4;
+    // Opcode byte plus two 5-byte varints.
+    static const int MAX_COMMAND_SIZE = 11;
+    // Status byte plus one 5-byte varint.
+    static const int MAX_RESULT_SIZE = 6;
+
+    // Constructor:
+    CommandLog() : lastStudent(0), lastCourse(0) {}
+
+    /**
+     * @brief Encode one command.
+     *
+     * @param command The command to encode.
+     * @param out Room for at least MAX_COMMAND_SIZE bytes.
+     * @return The number of bytes written.
+     */
+    int encode(const TechSystem::Command& command, unsigned char* out) {
+        int length = 0;
+        out[length++] = static_cast<unsigned char>(command.opcode);
+        switch (command.opcode) {
+            case TechSystem::Opcode::ADD_STUDENT:
+            case TechSystem::Opcode::REMOVE_STUDENT:
+            case TechSystem::Opcode::GET_STUDENT_POINTS:
+                length += putId(command.first, lastStudent, out + length);
+                break;
+            case TechSystem::Opcode::ADD_COURSE:
+                length += putId(command.first, lastCourse, out + length);
+                length += putVarint(zigzag(unsigned(command.second)), out + length);
+                break;
+            case TechSystem::Opcode::REMOVE_COURSE:
+                length += putId(command.first, lastCourse, out + length);
+                break;
+            case TechSystem::Opcode::ENROLL_STUDENT:
+            case TechSystem::Opcode::COMPLETE_COURSE:
+                length += putId(command.first, lastStudent, out + length);
+                length += putId(command.second, lastCourse, out + length);
+                break;
+            case TechSystem::Opcode::AWARD_ACADEMIC_POINTS:
+                length += putVarint(zigzag(unsigned(command.first)), out + length);
+                break;
+            case TechSystem::Opcode::WITHDRAW_STUDENT:
+                length += putId(command.first, lastStudent, out + length);
+                break;
+            case TechSystem::Opcode::FORCE_REMOVE_COURSE:
+                length += putId(command.first, lastCourse, out + length);
+                out[length++] = command.second != 0 ? 1 : 0;
+                break;
+            case TechSystem::Opcode::MERGE_COURSES:
+                length += putId(command.first, lastCourse, out + length);
+                length += putId(command.second, lastCourse, out + length);
+                break;
+            case TechSystem::Opcode::AWARD_COURSE_POINTS:
+                length += putId(command.first, lastCourse, out + length);
+                length += putVarint(zigzag(unsigned(command.second)), out + length);
+                break;
+        }
+        return length;
+    }
+
+    /**
+     * @brief Decode one command.
+     *
+     * @param in The encoded bytes.
+     * @param available Number of bytes readable at in.
+     * @param command Set to the decoded command.
+     * @return The number of bytes read, 0 if the record is cut short or
+     * malformed.
+     */
+    int decode(const unsigned char* in, const int available,
+               TechSystem::Command& command) {
+        if (available < 1 || in[0] > static_cast<unsigned char>(
+                TechSystem::Opcode::AWARD_COURSE_POINTS)) {
+            return 0;
+        }
+        command.opcode = static_cast<TechSystem::Opcode>(in[0]);
+        command.first = 0;
+        command.second = 0;
+        int length = 1;
+        unsigned value = 0;
+        switch (command.opcode) {
+            case TechSystem::Opcode::ADD_STUDENT:
+            case TechSystem::Opcode::REMOVE_STUDENT:
+            case TechSystem::Opcode::GET_STUDENT_POINTS:
+                length = getId(in, available, length, lastStudent, command.first);
+                break;
+            case TechSystem::Opcode::ADD_COURSE:
+                length = getId(in, available, length, lastCourse, command.first);
+                length = getVarint(in, available, length, value);
+                command.second = toInt(unzigzag(value));
+                break;
+            case TechSystem::Opcode::REMOVE_COURSE:
+                length = getId(in, available, length, lastCourse, command.first);
+                break;
+            case TechSystem::Opcode::ENROLL_STUDENT:
+            case TechSystem::Opcode::COMPLETE_COURSE:
+                length = getId(in, available, length, lastStudent, command.first);
+                length = getId(in, available, length, lastCourse, command.second);
+                break;
+            case TechSystem::Opcode::AWARD_ACADEMIC_POINTS:
+                length = getVarint(in, available, length, value);
+                command.first = toInt(unzigzag(value));
+                break;
+            case TechSystem::Opcode::WITHDRAW_STUDENT:
+                length = getId(in, available, length, lastStudent, command.first);
+                break;
+            case TechSystem::Opcode::FORCE_REMOVE_COURSE:
+                length = getId(in, available, length, lastCourse, command.first);
+                if (length == 0 || length >= available || in[length] > 1) {
+                    return 0;
+                }
+                command.second = in[length++];
+                break;
+            case TechSystem::Opcode::MERGE_COURSES:
+                length = getId(in, available, length, lastCourse, command.first);
+                length = getId(in, available, length, lastCourse, command.second);
+                break;
+            case TechSystem::Opcode::AWARD_COURSE_POINTS:
+                length = getId(in, available, length, lastCourse, command.first);
+                length = getVarint(in, available, length, value);
+                command.second = toInt(unzigzag(value));
+                break;
+        }
+        return length;
+    }
+
+    /**
+     * @brief Encode the result of a command.
+     *
+     * @param opcode The opcode of the command that produced it.
+     * @param result The result to encode.
+     * @param out Room for at least MAX_RESULT_SIZE bytes.
+     * @return The number of bytes written.
+     */
+    static int encodeResult(const TechSystem::Opcode opcode,
+                            const TechSystem::CommandResult& result,
+                            unsigned char* out) {
+        out[0] = static_cast<unsigned char>(result.status);
+        if (!hasValue(opcode, result.status)) {
+            return 1;
+        }
+        return 1 + putVarint(zigzag(unsigned(result.value)), out + 1);
+    }
+
+    /**
+     * @brief Decode the result of a command.
+     *
+     * @param opcode The opcode of the command that produced it.
+     * @param in The encoded bytes.
+     * @param available Number of bytes readable at in.
+     * @param result Set to the decoded result.
+     * @return The number of bytes read, 0 if the record is cut short or
+     * malformed.
+     */
+    static int decodeResult(const TechSystem::Opcode opcode,
+                            const unsigned char* in, const int available,
+                            TechSystem::CommandResult& result) {
+        if (available < 1 || in[0] > static_cast<unsigned char>(StatusType::FAILURE)) {
+            return 0;
+        }
+        result.status = static_cast<StatusType>(in[0]);
+        result.value = 0;
+        if (!hasValue(opcode, result.status)) {
+            return 1;
+        }
+        unsigned value = 0;
+        const int length = getVarint(in, available, 1, value);
+        result.value = toInt(unzigzag(value));
+        return length;
+    }
+
+    static const unsigned char* commandMagic() {
+        static const unsigned char magic[MAGIC_SIZE] = {'T', 'S', 'C', 'L'};
+        return magic;
+    }
+
+    static const unsigned char* resultMagic() {
+        static const unsigned char magic[MAGIC_SIZE] = {'T', 'S', 'C', 'R'};
+        return magic;
+    }
+
+    /**
+     * @brief Check that a log starts with the given magic.
+     */
+    static bool hasMagic(const unsigned char* in, const int available,
+                         const unsigned char* magic) {
+        if (available < MAGIC_SIZE) {
+            return false;
+        }
+        for (int i = 0; i < MAGIC_SIZE; ++i) {
+            if (in[i] != magic[i]) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+private:
+    int lastStudent;
+    int lastCourse;
+
+    static bool hasValue(const TechSystem::Opcode opcode, const StatusType status) {
+        return opcode == TechSystem::Opcode::GET_STUDENT_POINTS &&
+               status == StatusType::SUCCESS;
+    }
+
+    static unsigned zigzag(const unsigned value) {
+        return (value << 1) ^ (0u - (value >> 31));
+    }
+
+    static unsigned unzigzag(const unsigned value) {
+        return (value >> 1) ^ (0u - (value & 1));
+    }
+
+    // Two's complement reinterpretation, without implementation-defined casts.
+    static int toInt(const unsigned value) {
+        return value <= 2147483647u ? int(value) : -int(~value) - 1;
+    }
+
+    static int putVarint(unsigned value, unsigned char* out) {
+        int length = 0;
+        while (value >= 0x80) {
+            out[length++] = static_cast<unsigned char>(value | 0x80);
+            value >>= 7;
+        }
+        out[length++] = static_cast<unsigned char>(value);
+        return length;
+    }
+
+    // Reads a varint at in[offset], returns the offset after it or 0.
+    static int getVarint(const unsigned char* in, const int available,
+                         int offset, unsigned& value) {
+        if (offset == 0) {
+            return 0;
+        }
+        value = 0;
+        for (int shift = 0; shift < 35 && offset < available; shift += 7) {
+            const unsigned char byte = in[offset++];
+            value |= unsigned(byte & 0x7f) << shift;
+            if ((byte & 0x80) == 0) {
+                return offset;
+            }
+        }
+        return 0;
+    }
+
+    static int putId(const int id, int& last, unsigned char* out) {
+        const int length = putVarint(zigzag(unsigned(id) - unsigned(last)), out);
+        last = id;
+        return length;
+    }
+
+    static int getId(const unsigned char* in, const int available, const int offset,
+                     int& last, int& id) {
+        unsigned delta = 0;
+        const int next = getVarint(in, available, offset, delta);
+        if (next != 0) {
+            id = toInt(unsigned(last) + unzigzag(delta));
+            last = id;
+        }
+        return next;
+    }
+};
+
+#endif //COMMANDLOG_H
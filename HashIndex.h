@@ -0,0 +1,380 @@
+#ifndef HASHINDEX_H
+#define HASHINDEX_H
+
+#include "Tree.h"
+
+/**
+ * @brief An open-addressing hash table from int ids to handles.
+ *
+ * Has the same contract as Tree, keyed by int(*value), for point lookups
+ * that need no ordering. Slots hold the key next to the value and are
+ * probed linearly, so a lookup usually costs a single cache miss.
+ *
+ * Growing is incremental: a new table twice the size is allocated and
+ * every insert or remove moves a few entries over from the old one, so
+ * no single operation pays for rehashing the whole table. Lookups check
+ * both tables while that is in progress.
+ *
+ * Removal shifts the following entries of the probe run back, so the
+ * table never fills up with tombstones. Tombstones are only used in the
+ * table being drained, which receives no new entries.
+ *
+ * Pointers returned by tryFind() are valid until the next insert or remove.
+ * The two smallest int values are reserved as slot markers.
+ *
+ * @tparam T The type of the handles stored in the table.
+ */
+template <typename T>
+class HashIndex
+{
+private:
+    static const int EMPTY = -2147483647 - 1;
+    static const int TOMBSTONE = EMPTY + 1;
+    static const int MIN_CAPACITY = 16;
+    // Old slots moved over per insert or remove while growing.
+    static const int MIGRATE_STEP = 16;
+
+    struct Slot {
+        int key;
+        T value;
+    };
+
+    struct Table {
+        Slot* slots;
+        int capacity; // a power of two, or 0.
+        int shift;    // 32 - log2(capacity), for Fibonacci hashing.
+        int count;
+    };
+
+    Table current;
+    Table old; // being drained into current while old.slots != nullptr.
+    int migrated; // old slots below this index were already moved.
+
+    static Table emptyTable() {
+        Table table;
+        table.slots = nullptr;
+        table.capacity = 0;
+        table.shift = 32;
+        table.count = 0;
+        return table;
+    }
+
+    // @throws std::bad_alloc
+    static Table allocateTable(const int capacity) {
+        Table table;
+        table.slots = new Slot[capacity];
+        table.capacity = capacity;
+        table.shift = 32;
+        for (int size = capacity; size > 1; size /= 2) {
+            table.shift--;
+        }
+        table.count = 0;
+        for (int i = 0; i < capacity; ++i) {
+            table.slots[i].key = EMPTY;
+        }
+        return table;
+    }
+
+    static int home(const Table& table, const int key) {
+        return int((unsigned(key) * 2654435769u) >> table.shift);
+    }
+
+    static int keyOf(const T& value) {
+        return static_cast<int>(*value);
+    }
+
+    // Index of key in table, or -1. Skips tombstones, stops at empty slots.
+    static int locate(const Table& table, const int key) {
+        if (table.capacity == 0) {
+            return -1;
+        }
+        const int mask = table.capacity - 1;
+        for (int i = home(table, key);; i = (i + 1) & mask) {
+            const int found = table.slots[i].key;
+            if (found == key) {
+                return i;
+            }
+            if (found == EMPTY) {
+                return -1;
+            }
+        }
+    }
+
+    // Place a key known to be absent, the table must have a free slot.
+    static void place(Table& table, const int key, const T& value) {
+        const int mask = table.capacity - 1;
+        int i = home(table, key);
+        while (table.slots[i].key != EMPTY) {
+            i = (i + 1) & mask;
+        }
+        table.slots[i].key = key;
+        table.slots[i].value = value;
+        table.count++;
+    }
+
+    // Remove the entry at index by shifting the rest of its probe run back.
+    static void erase(Table& table, int index) {
+        const int mask = table.capacity - 1;
+        int next = index;
+        while (true) {
+            next = (next + 1) & mask;
+            const int key = table.slots[next].key;
+            if (key == EMPTY) {
+                break;
+            }
+            // An entry may fill the hole only if its home is not after it.
+            const int desired = home(table, key);
+            const bool stays = index <= next ? (index < desired && desired <= next)
+                                             : (index < desired || desired <= next);
+            if (!stays) {
+                table.slots[index] = table.slots[next];
+                index = next;
+            }
+        }
+        table.slots[index].key = EMPTY;
+        table.count--;
+    }
+
+    // Move up to MIGRATE_STEP old slots into the current table.
+    void migrateStep() {
+        if (old.slots == nullptr) {
+            return;
+        }
+        const int stop = migrated + MIGRATE_STEP < old.capacity ?
+            migrated + MIGRATE_STEP : old.capacity;
+        for (; migrated < stop; ++migrated) {
+            Slot& slot = old.slots[migrated];
+            if (slot.key != EMPTY && slot.key != TOMBSTONE) {
+                place(current, slot.key, slot.value);
+                // Keeps probe runs through this slot intact for lookups.
+                slot.key = TOMBSTONE;
+                old.count--;
+            }
+        }
+        if (migrated == old.capacity) {
+            delete[] old.slots;
+            old = emptyTable();
+        }
+    }
+
+    // Move every remaining old entry over at once.
+    void finishMigration() {
+        while (old.slots != nullptr) {
+            migrateStep();
+        }
+    }
+
+    // Make room for one more entry, starting a migration if needed.
+    // @throws std::bad_alloc with the table unchanged.
+    void prepareInsert() {
+        // Keep the load at most 0.7.
+        if ((current.count + 1) * 10LL <= current.capacity * 7LL) {
+            return;
+        }
+        finishMigration();
+        Table bigger = allocateTable(current.capacity ?
+                                     current.capacity * 2 : MIN_CAPACITY);
+        old = current;
+        current = bigger;
+        migrated = 0;
+        if (old.capacity == 0) {
+            old = emptyTable();
+        }
+    }
+
+public:
+    // Constructor:
+    HashIndex() : current(emptyTable()), old(emptyTable()), migrated(0) {}
+
+    HashIndex(const HashIndex&) = delete;
+    HashIndex& operator=(const HashIndex&) = delete;
+
+    // Destructor:
+    ~HashIndex() {
+        delete[] current.slots;
+        delete[] old.slots;
+    }
+
+    /**
+     * @brief Public insert method.
+     *
+     * @param value The value to insert.
+     * @throws KeyExistsException if the key already exists in the table.
+     */
+    void insert(const T& value) {
+        if (tryInsert(value) != TreeResult::SUCCESS) {
+            throw KeyExistsException();
+        }
+    }
+
+    /**
+     * @brief Public remove method.
+     *
+     * @param key The key to remove.
+     * @throws KeyNotFoundException if the key is not found in the table.
+     */
+    void remove(const int key) {
+        if (tryRemove(key) != TreeResult::SUCCESS) {
+            throw KeyNotFoundException();
+        }
+    }
+
+    /**
+     * @brief Public find method.
+     *
+     * @param key The key to find.
+     * @return Reference to the value stored in the table.
+     * @throws KeyNotFoundException if the key is not found in the table.
+     */
+    T& find(const int& key) const {
+        T* found = tryFind(key);
+        if (found == nullptr) {
+            throw KeyNotFoundException();
+        }
+        return *found;
+    }
+
+    /**
+     * @brief Insert a value without throwing on duplicates.
+     *
+     * @param value The value to insert, keyed by int(*value).
+     * @return SUCCESS, or KEY_EXISTS if the key is already in the table.
+     * @throws std::bad_alloc with the table unchanged.
+     */
+    TreeResult tryInsert(const T& value) {
+        const int key = keyOf(value);
+        if (tryFind(key) != nullptr) {
+            return TreeResult::KEY_EXISTS;
+        }
+        prepareInsert();
+        place(current, key, value);
+        migrateStep();
+        return TreeResult::SUCCESS;
+    }
+
+    /**
+     * @brief Remove a key without throwing if it is missing.
+     *
+     * @param key The key to remove.
+     * @return SUCCESS, or KEY_NOT_FOUND if the key is not in the table.
+     */
+    TreeResult tryRemove(const int key) {
+        const int index = locate(current, key);
+        if (index >= 0) {
+            erase(current, index);
+        } else {
+            const int oldIndex = locate(old, key);
+            if (oldIndex < 0) {
+                return TreeResult::KEY_NOT_FOUND;
+            }
+            old.slots[oldIndex].key = TOMBSTONE;
+            old.count--;
+        }
+        migrateStep();
+        return TreeResult::SUCCESS;
+    }
+
+    /**
+     * @brief Find a key without throwing if it is missing.
+     *
+     * @param key The key to find.
+     * @return Pointer to the value stored in the table, or nullptr if not
+     * found. Valid until the next insert or remove.
+     */
+    T* tryFind(const int& key) const {
+        int index = locate(current, key);
+        if (index >= 0) {
+            return &current.slots[index].value;
+        }
+        index = locate(old, key);
+        return index >= 0 ? &old.slots[index].value : nullptr;
+    }
+
+    /**
+     * @brief Make room for count entries in total, so that inserts up to
+     * that size do not allocate.
+     *
+     * @param count The number of entries to make room for.
+     * @throws std::bad_alloc with the table unchanged.
+     */
+    void reserve(int count) {
+        if (count < size()) {
+            count = size();
+        }
+        int capacity = current.capacity ? current.capacity : MIN_CAPACITY;
+        while (count * 10LL > capacity * 7LL) {
+            capacity *= 2;
+        }
+        if (capacity == current.capacity && old.slots == nullptr) {
+            return;
+        }
+        Table bigger = allocateTable(capacity);
+        for (int i = 0; i < current.capacity; ++i) {
+            if (current.slots[i].key != EMPTY) {
+                place(bigger, current.slots[i].key, current.slots[i].value);
+            }
+        }
+        for (int i = migrated; i < old.capacity; ++i) {
+            const int key = old.slots[i].key;
+            if (key != EMPTY && key != TOMBSTONE) {
+                place(bigger, key, old.slots[i].value);
+            }
+        }
+        delete[] current.slots;
+        delete[] old.slots;
+        current = bigger;
+        old = emptyTable();
+        migrated = 0;
+    }
+
+    /**
+     * @brief Call f on every value, in no particular order.
+     */
+    template <typename F>
+    void forEach(F f) const {
+        for (int i = 0; i < current.capacity; ++i) {
+            if (current.slots[i].key != EMPTY) {
+                f(current.slots[i].value);
+            }
+        }
+        for (int i = migrated; i < old.capacity; ++i) {
+            const int key = old.slots[i].key;
+            if (key != EMPTY && key != TOMBSTONE) {
+                f(old.slots[i].value);
+            }
+        }
+    }
+
+    /**
+     * @brief Remove all keys from the table.
+     *
+     * @param dispose Called on every value before the table is emptied.
+     */
+    template <typename Dispose>
+    void clear(Dispose dispose) {
+        forEach(dispose);
+        delete[] current.slots;
+        delete[] old.slots;
+        current = emptyTable();
+        old = emptyTable();
+        migrated = 0;
+    }
+
+    /**
+     * @brief Number of keys in the table.
+     */
+    int size() const {
+        return current.count + old.count;
+    }
+
+    /**
+     * @brief Check if the table is empty.
+     *
+     * @return true if the table is empty, false otherwise.
+     */
+    bool isEmpty() const {
+        return size() == 0;
+    }
+};
+
+#endif //HASHINDEX_H
@@ -0,0 +1,204 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include <new>
+#include <utility>
+
+/**
+ * @brief A slab allocator for objects of a single type.
+ *
+ * Objects are carved out of geometrically growing slabs, and destroyed
+ * objects are kept on a free list to be recycled by the next create(),
+ * so steady insert/remove churn does not touch malloc at all.
+ * Slabs are released only when the pool itself is destroyed, objects
+ * still alive at that point are not destructed.
+ *
+ * @tparam T The type of the pooled objects.
+ */
+template <typename T>
+class ObjectPool
+{
+private:
+    // A free slot stores the link to the next free slot in place of the object.
+    union Slot {
+        Slot* next;
+        alignas(T) unsigned char storage[sizeof(T)];
+    };
+
+    struct Slab {
+        Slab* next;
+        int capacity;
+    };
+
+    static const int FIRST_SLAB_SIZE = 64;
+    static const int MAX_SLAB_SIZE = 1 << 16;
+
+    Slab* slabs;
+    Slot* freeList;
+    // Bump region of the newest slab:
+    Slot* nextSlot;
+    Slot* slabEnd;
+    int nextSlabSize;
+
+    static Slot* slotsOf(Slab* slab) {
+        return reinterpret_cast<Slot*>(slab + 1);
+    }
+
+    // Allocate a fresh slab, doubling the size of the previous one.
+    void grow() {
+        static_assert(sizeof(Slab) % alignof(Slot) == 0,
+                      "slots must stay aligned after the slab header");
+        void* memory = ::operator new(sizeof(Slab) + sizeof(Slot) * nextSlabSize);
+        Slab* slab = static_cast<Slab*>(memory);
+        slab->next = slabs;
+        slab->capacity = nextSlabSize;
+        slabs = slab;
+
+        nextSlot = slotsOf(slab);
+        slabEnd = nextSlot + nextSlabSize;
+        if (nextSlabSize < MAX_SLAB_SIZE) {
+            nextSlabSize *= 2;
+        }
+    }
+
+    Slot* takeSlot() {
+        if (freeList != nullptr) {
+            Slot* slot = freeList;
+            freeList = slot->next;
+            return slot;
+        }
+        if (nextSlot == slabEnd) {
+            grow();
+        }
+        return nextSlot++;
+    }
+
+    void releaseSlot(Slot* slot) {
+        slot->next = freeList;
+        freeList = slot;
+    }
+
+public:
+    ObjectPool() : slabs(nullptr), freeList(nullptr), nextSlot(nullptr),
+                   slabEnd(nullptr), nextSlabSize(FIRST_SLAB_SIZE) {}
+
+    ObjectPool(const ObjectPool&) = delete;
+    ObjectPool& operator=(const ObjectPool&) = delete;
+
+    ~ObjectPool() {
+        while (slabs != nullptr) {
+            Slab* next = slabs->next;
+            ::operator delete(slabs);
+            slabs = next;
+        }
+    }
+
+    /**
+     * @brief Construct a new object in a recycled or fresh slot.
+     *
+     * @param args Arguments forwarded to the constructor of T.
+     * @return Pointer to the new object.
+     * @throws std::bad_alloc if a new slab cannot be allocated.
+     */
+    template <typename... Args>
+    T* create(Args&&... args) {
+        Slot* slot = takeSlot();
+        try {
+            return new (slot->storage) T(std::forward<Args>(args)...);
+        } catch (...) {
+            releaseSlot(slot);
+            throw;
+        }
+    }
+
+    /**
+     * @brief Destruct an object and return its slot to the free list.
+     *
+     * @param object An object returned by create() of this pool.
+     */
+    void destroy(T* object) {
+        object->~T();
+        releaseSlot(reinterpret_cast<Slot*>(object));
+    }
+};
+
+/**
+ * @brief A heap array released when it goes out of scope.
+ *
+ * @tparam T The element type.
+ */
+template <typename T>
+class ScopedArray
+{
+private:
+    T* data;
+
+public:
+    // @throws std::bad_alloc if the array cannot be allocated.
+    explicit ScopedArray(const int count) : data(new T[count > 0 ? count : 1]) {}
+
+    ScopedArray(const ScopedArray&) = delete;
+    ScopedArray& operator=(const ScopedArray&) = delete;
+
+    ~ScopedArray() {
+        delete[] data;
+    }
+
+    T* get() const {
+        return data;
+    }
+
+    T& operator[](const int index) const {
+        return data[index];
+    }
+};
+
+/**
+ * @brief Node allocator policy using plain new/delete.
+ *
+ * @tparam N The node type.
+ */
+template <typename N>
+struct HeapAllocator
+{
+    template <typename... Args>
+    static N* create(Args&&... args) {
+        return new N(std::forward<Args>(args)...);
+    }
+
+    static void destroy(N* node) {
+        delete node;
+    }
+};
+
+/**
+ * @brief Node allocator policy backed by an ObjectPool shared by all trees
+ * with the same node type.
+ *
+ * Sharing the pool lets nodes freed by one tree be recycled by another,
+ * which is the common pattern for the many small per-course trees.
+ * The pool is not thread-safe.
+ *
+ * @tparam N The node type.
+ */
+template <typename N>
+struct PoolAllocator
+{
+    // Intentionally never destroyed, so trees living in static storage
+    // can still free their nodes during program exit.
+    static ObjectPool<N>& pool() {
+        static ObjectPool<N>* shared = new ObjectPool<N>();
+        return *shared;
+    }
+
+    template <typename... Args>
+    static N* create(Args&&... args) {
+        return pool().create(std::forward<Args>(args)...);
+    }
+
+    static void destroy(N* node) {
+        pool().destroy(node);
+    }
+};
+
+#endif //POOL_H
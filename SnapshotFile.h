@@ -0,0 +1,516 @@
+#ifndef SNAPSHOTFILE_H
+#define SNAPSHOTFILE_H
+
+#include <cstdio>
+#include <new>
+
+// Mapping and syncing are POSIX only. Elsewhere files are read and written
+// through stdio alone, and a snapshot is as durable as the OS cache makes it.
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+/**
+ * @brief Make a rename or a new file under path durable, by syncing the
+ * directory that holds it.
+ *
+ * @return false if the directory cannot be synced, always true where
+ * directories cannot be synced.
+ * @throws std::bad_alloc
+ */
+inline bool syncParentDirectory(const char* const path) {
+#ifdef _WIN32
+    (void)path;
+    return true;
+#else
+    int slash = -1;
+    int length = 0;
+    for (; path[length] != '\0'; ++length) {
+        if (path[length] == '/') {
+            slash = length;
+        }
+    }
+    char* directory = new char[slash > 0 ? slash + 1 : 2];
+    if (slash > 0) {
+        for (int i = 0; i < slash; ++i) {
+            directory[i] = path[i];
+        }
+        directory[slash] = '\0';
+    } else {
+        directory[0] = slash == 0 ? '/' : '.';
+        directory[1] = '\0';
+    }
+    const int descriptor = ::open(directory, O_RDONLY);
+    delete[] directory;
+    if (descriptor < 0) {
+        return false;
+    }
+    const bool synced = fsync(descriptor) == 0;
+    ::close(descriptor);
+    return synced;
+#endif
+}
+
+/**
+ * @brief A read-only view of a snapshot image, as written by
+ * TechSystem::saveSnapshot().
+ *
+ * An image is a Header followed by flat int arrays in native byte order:
+ *
+ *   studentIds[S]              studentPoints[S]
+ *   studentCourseOffsets[S+1]  studentCourses[E]
+ *   courseIds[C]               coursePoints[C]
+ *   rosterOffsets[C+1]         rosters[E]
+ *
+ * Student and course ids are strictly increasing, and student points do
+ * not include the bonus, which is stored once in the header. Enrollments
+ * are stored from both sides in compressed sparse row form: the courses of
+ * student i are studentCourses[studentCourseOffsets[i]] up to
+ * studentCourses[studentCourseOffsets[i + 1]], in increasing id order, and
+ * the rosters are laid out the same way.
+ *
+ * Nothing needs decoding, so a mapped image can be queried in place by
+ * binary search, and every list is already sorted for the linear-time
+ * bulk loads of TechSystem::loadSnapshot(). The header also carries an
+ * opaque log position, how much of a WriteAheadLog the image covers.
+ */
+class SnapshotImage
+{
+public:
+    struct Header {
+        unsigned char magic[4];
+        // BYTE_ORDER_MARK as the writer saw it.
+        int byteOrder;
+        long long logPosition;
+        int version;
+        int bonus;
+        int studentCount;
+        int courseCount;
+        int enrollmentCount;
+        // Zero, so that the header has no padding of unspecified value.
+        int reserved;
+    };
+
+    static const int VERSION = 2;
+    static const int BYTE_ORDER_MARK = 0x01020304;
+
+    static const unsigned char* magic() {
+        static const unsigned char magic[4] = {'T', 'S', 'S', 'N'};
+        return magic;
+    }
+
+    /**
+     * @brief Size in bytes of an image with the given counts.
+     */
+    static long long sizeFor(const int students, const int courses, const int enrollments) {
+        return (long long)sizeof(Header) +
+               (long long)sizeof(int) * (3LL * students + 1 + 3LL * courses + 1 +
+                                         2LL * enrollments);
+    }
+
+    // Constructor, for an empty view:
+    SnapshotImage() : header(nullptr), studentIdArray(nullptr), studentPointArray(nullptr),
+                      studentCourseOffsetArray(nullptr), studentCourseArray(nullptr),
+                      courseIdArray(nullptr), coursePointArray(nullptr),
+                      rosterOffsetArray(nullptr), rosterArray(nullptr) {}
+
+    /**
+     * @brief Check an image and point the view at its arrays.
+     *
+     * Checks the header, the size, the order of every id list and the
+     * bounds of every offset, in time linear in the size of the image.
+     * That the two sides of the enrollments mirror each other is left to
+     * the loader, a view only needs every access to stay in bounds.
+     *
+     * @param data The image, aligned for int. Must outlive the view.
+     * @param size Number of bytes at data.
+     * @return false if the bytes are not a well-formed image.
+     */
+    bool open(const unsigned char* const data, const long long size) {
+        static_assert(sizeof(Header) == 40, "the header must not have padding");
+        header = nullptr;
+        if (data == nullptr || size < (long long)sizeof(Header)) {
+            return false;
+        }
+        const Header* candidate = reinterpret_cast<const Header*>(data);
+        for (int i = 0; i < 4; ++i) {
+            if (candidate->magic[i] != magic()[i]) {
+                return false;
+            }
+        }
+        if (candidate->byteOrder != BYTE_ORDER_MARK || candidate->version != VERSION ||
+            candidate->studentCount < 0 || candidate->courseCount < 0 ||
+            candidate->enrollmentCount < 0 ||
+            size != sizeFor(candidate->studentCount, candidate->courseCount,
+                            candidate->enrollmentCount)) {
+            return false;
+        }
+        const int students = candidate->studentCount;
+        const int courses = candidate->courseCount;
+        const int enrollments = candidate->enrollmentCount;
+        const int* next = reinterpret_cast<const int*>(candidate + 1);
+        studentIdArray = next;
+        studentPointArray = studentIdArray + students;
+        studentCourseOffsetArray = studentPointArray + students;
+        studentCourseArray = studentCourseOffsetArray + students + 1;
+        courseIdArray = studentCourseArray + enrollments;
+        coursePointArray = courseIdArray + courses;
+        rosterOffsetArray = coursePointArray + courses;
+        rosterArray = rosterOffsetArray + courses + 1;
+
+        if (!isIncreasing(studentIdArray, students) || !isIncreasing(courseIdArray, courses) ||
+            !areLists(studentCourseOffsetArray, studentCourseArray, students, enrollments) ||
+            !areLists(rosterOffsetArray, rosterArray, courses, enrollments)) {
+            return false;
+        }
+        for (int i = 0; i < courses; ++i) {
+            if (coursePointArray[i] <= 0) {
+                return false;
+            }
+        }
+        header = candidate;
+        return true;
+    }
+
+    bool isOpen() const {
+        return header != nullptr;
+    }
+
+    int bonus() const {
+        return header->bonus;
+    }
+
+    long long logPosition() const {
+        return header->logPosition;
+    }
+
+    int studentCount() const {
+        return header->studentCount;
+    }
+
+    int courseCount() const {
+        return header->courseCount;
+    }
+
+    int enrollmentCount() const {
+        return header->enrollmentCount;
+    }
+
+    const int* studentIds() const {
+        return studentIdArray;
+    }
+
+    // Points without the bonus, add bonus() for what getStudentPoints reports.
+    const int* studentPoints() const {
+        return studentPointArray;
+    }
+
+    const int* studentCourseOffsets() const {
+        return studentCourseOffsetArray;
+    }
+
+    const int* studentCourses() const {
+        return studentCourseArray;
+    }
+
+    const int* courseIds() const {
+        return courseIdArray;
+    }
+
+    const int* coursePoints() const {
+        return coursePointArray;
+    }
+
+    const int* rosterOffsets() const {
+        return rosterOffsetArray;
+    }
+
+    const int* rosters() const {
+        return rosterArray;
+    }
+
+    /**
+     * @brief Index of a student in the arrays, in O(log n).
+     *
+     * @return The index, or -1 if the student is not in the image.
+     */
+    int findStudent(const int studentId) const {
+        return find(studentIdArray, header->studentCount, studentId);
+    }
+
+    /**
+     * @brief Index of a course in the arrays, in O(log m).
+     *
+     * @return The index, or -1 if the course is not in the image.
+     */
+    int findCourse(const int courseId) const {
+        return find(courseIdArray, header->courseCount, courseId);
+    }
+
+private:
+    const Header* header;
+    const int* studentIdArray;
+    const int* studentPointArray;
+    const int* studentCourseOffsetArray;
+    const int* studentCourseArray;
+    const int* courseIdArray;
+    const int* coursePointArray;
+    const int* rosterOffsetArray;
+    const int* rosterArray;
+
+    // Positive and strictly increasing.
+    static bool isIncreasing(const int* ids, const int count) {
+        for (int i = 0; i < count; ++i) {
+            if (ids[i] <= (i > 0 ? ids[i - 1] : 0)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // count lists of positive, strictly increasing ids, total long in all.
+    static bool areLists(const int* offsets, const int* ids, const int count,
+                         const int total) {
+        if (offsets[0] != 0 || offsets[count] != total) {
+            return false;
+        }
+        for (int i = 0; i < count; ++i) {
+            if (offsets[i + 1] < offsets[i] || offsets[i + 1] > total ||
+                !isIncreasing(ids + offsets[i], offsets[i + 1] - offsets[i])) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    static int find(const int* ids, const int count, const int id) {
+        int low = 0;
+        int high = count;
+        while (low < high) {
+            const int mid = low + (high - low) / 2;
+            if (ids[mid] < id) {
+                low = mid + 1;
+            } else {
+                high = mid;
+            }
+        }
+        return low < count && ids[low] == id ? low : -1;
+    }
+};
+
+/**
+ * @brief A whole file in memory, mapped read-only where the platform and
+ * the file system allow it and read into a heap buffer otherwise.
+ */
+class MappedFile
+{
+public:
+    MappedFile() : bytes(nullptr), length(0), mapped(false) {}
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    ~MappedFile() {
+#ifndef _WIN32
+        if (mapped) {
+            munmap(bytes, size_t(length));
+            return;
+        }
+#endif
+        delete[] bytes;
+    }
+
+    /**
+     * @brief Open a file, at most once per object.
+     *
+     * @return false if the file cannot be opened or read.
+     * @throws std::bad_alloc if the file has to be read into a buffer that
+     * cannot be allocated.
+     */
+    bool open(const char* const path) {
+#ifndef _WIN32
+        const int descriptor = ::open(path, O_RDONLY);
+        if (descriptor < 0) {
+            return false;
+        }
+        struct stat info;
+        if (fstat(descriptor, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0) {
+            void* address = mmap(nullptr, size_t(info.st_size), PROT_READ, MAP_PRIVATE,
+                                 descriptor, 0);
+            if (address != MAP_FAILED) {
+                bytes = static_cast<unsigned char*>(address);
+                length = (long long)info.st_size;
+                mapped = true;
+                ::close(descriptor);
+                return true;
+            }
+        }
+        ::close(descriptor);
+#endif
+        // Empty files, file systems that cannot map and platforms without mmap.
+        std::FILE* file = std::fopen(path, "rb");
+        if (file == nullptr) {
+            return false;
+        }
+        bool success;
+        try {
+            success = readAll(file);
+        } catch (std::bad_alloc&) {
+            std::fclose(file);
+            throw;
+        }
+        std::fclose(file);
+        return success;
+    }
+
+    const unsigned char* data() const {
+        return bytes;
+    }
+
+    long long size() const {
+        return length;
+    }
+
+private:
+    unsigned char* bytes;
+    long long length;
+    bool mapped;
+
+    // Reads to the end of file, doubling the buffer as it fills up.
+    // @throws std::bad_alloc
+    bool readAll(std::FILE* const file) {
+        long long capacity = 1 << 16;
+        bytes = new unsigned char[size_t(capacity)];
+        size_t got;
+        while ((got = std::fread(bytes + length, 1, size_t(capacity - length), file)) > 0) {
+            length += (long long)got;
+            if (length == capacity) {
+                unsigned char* larger = new unsigned char[size_t(2 * capacity)];
+                for (long long i = 0; i < length; ++i) {
+                    larger[i] = bytes[i];
+                }
+                delete[] bytes;
+                bytes = larger;
+                capacity *= 2;
+            }
+        }
+        return std::ferror(file) == 0;
+    }
+};
+
+/**
+ * @brief Buffered writer of a snapshot image.
+ *
+ * The image goes to a temporary file next to the target, which commit()
+ * syncs and renames over the target, and then syncs the directory so the
+ * rename itself survives a crash. A crash or a failed write leaves the
+ * previous snapshot at the target untouched.
+ */
+class SnapshotWriter
+{
+public:
+    SnapshotWriter() : file(nullptr), target(nullptr), temporary(nullptr), used(0),
+                       failed(false) {}
+
+    SnapshotWriter(const SnapshotWriter&) = delete;
+    SnapshotWriter& operator=(const SnapshotWriter&) = delete;
+
+    ~SnapshotWriter() {
+        if (file != nullptr) {
+            std::fclose(file);
+            std::remove(temporary);
+        }
+        delete[] temporary;
+    }
+
+    /**
+     * @brief Create the temporary file for a snapshot at path.
+     *
+     * @return false if the file cannot be created.
+     * @throws std::bad_alloc
+     */
+    bool open(const char* const path) {
+        int pathLength = 0;
+        while (path[pathLength] != '\0') {
+            ++pathLength;
+        }
+        static const char SUFFIX[] = ".tmp";
+        temporary = new char[pathLength + sizeof(SUFFIX)];
+        for (int i = 0; i < pathLength; ++i) {
+            temporary[i] = path[i];
+        }
+        for (int i = 0; i < int(sizeof(SUFFIX)); ++i) {
+            temporary[pathLength + i] = SUFFIX[i];
+        }
+        target = path;
+        file = std::fopen(temporary, "wb");
+        return file != nullptr;
+    }
+
+    // Must come before any put().
+    void putHeader(const SnapshotImage::Header& header) {
+        write(&header, sizeof(header));
+    }
+
+    void put(const int value) {
+        if (used == BUFFER_SIZE) {
+            flush();
+        }
+        buffer[used++] = value;
+    }
+
+    /**
+     * @brief Make the snapshot durable and move it over the target.
+     *
+     * @return false if any write failed, the target is unchanged then
+     * unless only the final directory sync failed.
+     * @throws std::bad_alloc
+     */
+    bool commit() {
+        flush();
+        failed = failed || std::fflush(file) != 0;
+#ifndef _WIN32
+        failed = failed || fsync(fileno(file)) != 0;
+#endif
+        failed = std::fclose(file) != 0 || failed;
+        file = nullptr;
+#ifdef _WIN32
+        // rename() does not replace an existing file here, so a crash
+        // between the two calls leaves only the temporary file.
+        if (!failed) {
+            std::remove(target);
+        }
+#endif
+        if (failed || std::rename(temporary, target) != 0) {
+            std::remove(temporary);
+            return false;
+        }
+        return syncParentDirectory(target);
+    }
+
+private:
+    static const int BUFFER_SIZE = 4096;
+
+    std::FILE* file;
+    const char* target;
+    char* temporary;
+    int buffer[BUFFER_SIZE];
+    int used;
+    bool failed;
+
+    void write(const void* data, const size_t size) {
+        if (size > 0 && std::fwrite(data, 1, size, file) != size) {
+            failed = true;
+        }
+    }
+
+    void flush() {
+        write(buffer, sizeof(int) * size_t(used));
+        used = 0;
+    }
+};
+
+#endif //SNAPSHOTFILE_H
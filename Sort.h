@@ -0,0 +1,85 @@
+#ifndef SORT_H
+#define SORT_H
+
+#include "Pool.h"
+
+/**
+ * @brief Check whether a range is in non-decreasing order.
+ *
+ * @param data The range.
+ * @param count Number of elements.
+ * @param less Strict weak ordering on the elements.
+ */
+template <typename T, typename Less>
+bool isSorted(const T* data, const int count, Less less) {
+    for (int i = 1; i < count; ++i) {
+        if (less(data[i], data[i - 1])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Stable bottom-up merge sort into a caller-provided buffer.
+ *
+ * @param data The range to sort in place.
+ * @param count Number of elements.
+ * @param less Strict weak ordering on the elements.
+ * @param scratch Room for count elements, clobbered by the sort.
+ */
+template <typename T, typename Less>
+void sortRange(T* data, const int count, Less less, T* scratch) {
+    if (count < 2 || isSorted(data, count, less)) {
+        return;
+    }
+    T* from = data;
+    T* to = scratch;
+    for (int width = 1; width < count; width *= 2) {
+        for (int low = 0; low < count; low += 2 * width) {
+            const int mid = low + width < count ? low + width : count;
+            const int high = low + 2 * width < count ? low + 2 * width : count;
+            int left = low;
+            int right = mid;
+            int out = low;
+            while (left < mid && right < high) {
+                // Take from the right run only if strictly smaller, for stability.
+                to[out++] = less(from[right], from[left]) ? from[right++] : from[left++];
+            }
+            while (left < mid) {
+                to[out++] = from[left++];
+            }
+            while (right < high) {
+                to[out++] = from[right++];
+            }
+        }
+        T* swap = from;
+        from = to;
+        to = swap;
+    }
+    if (from != data) {
+        for (int i = 0; i < count; ++i) {
+            data[i] = from[i];
+        }
+    }
+}
+
+/**
+ * @brief Stable bottom-up merge sort.
+ *
+ * @param data The range to sort in place.
+ * @param count Number of elements.
+ * @param less Strict weak ordering on the elements.
+ * @throws std::bad_alloc if the scratch buffer cannot be allocated,
+ * data is left untouched in that case.
+ */
+template <typename T, typename Less>
+void sortRange(T* data, const int count, Less less) {
+    if (count < 2 || isSorted(data, count, less)) {
+        return;
+    }
+    ScopedArray<T> scratch(count);
+    sortRange(data, count, less, scratch.get());
+}
+
+#endif //SORT_H
@@ -0,0 +1,39 @@
+#ifndef STANDING_H
+#define STANDING_H
+
+#include "Tree.h"
+
+/**
+ * @brief A student's place on a leaderboard, its own key in a Tree.
+ *
+ * Standings order by points, most first, then by id, smallest first, so a
+ * tree of standings begins with the leader and rank() is the number of
+ * students ahead. Looked up by the whole standing, see TreeKeyTraits.
+ */
+struct Standing {
+    int points;
+    int id;
+
+    explicit Standing(const int points = 0, const int id = 0) : points(points), id(id) {}
+
+    const Standing& operator*() const {
+        return *this;
+    }
+
+    bool operator<(const Standing& other) const {
+        return points != other.points ? points > other.points : id < other.id;
+    }
+    bool operator>(const Standing& other) const {
+        return other < *this;
+    }
+    bool operator==(const Standing& other) const {
+        return points == other.points && id == other.id;
+    }
+};
+
+template <>
+struct TreeKeyTraits<Standing> {
+    typedef Standing Key;
+};
+
+#endif //STANDING_H
@@ -0,0 +1,277 @@
+#ifndef STUDENTSTORE_H
+#define STUDENTSTORE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+
+template <typename Courses>
+class StudentStore;
+
+/**
+ * @brief A student in a StudentStore, the address of its entry in the id
+ * column. Dereferencing gives the id, which is all the indexes need to
+ * order and hash students, and the store finds the slot's other columns
+ * from the address. Stays valid until the student is destroyed.
+ */
+class StudentHandle
+{
+private:
+    template <typename Courses>
+    friend class StudentStore;
+
+    const int* id;
+
+    explicit StudentHandle(const int* id) : id(id) {}
+
+public:
+    StudentHandle() : id(nullptr) {}
+
+    int operator*() const {
+        return *id;
+    }
+
+    bool operator==(const StudentHandle& other) const {
+        return id == other.id;
+    }
+
+    bool operator!=(const StudentHandle& other) const {
+        return id != other.id;
+    }
+};
+
+/**
+ * @brief Student records as dense parallel arrays, one column per field.
+ *
+ * Slots live in chunks of SLOTS_PER_CHUNK, and a chunk keeps each field in
+ * an array of its own: ids, stored points, course counts and the course
+ * indexes. Scanning one field streams through contiguous memory, and a
+ * chunk never moves once allocated, so handles stay valid while the store
+ * grows. Chunks are aligned to their size, which lets a handle find its
+ * chunk by masking its address.
+ *
+ * Removed slots go on a free list and are reused before the store grows.
+ * A free slot keeps ~next in its id, the complement of the next free slot
+ * number or of -1 at the end of the list, so every free id is <= 0 and
+ * live and free slots can be told apart in the id column.
+ *
+ * @tparam Courses The type of a student's course index, constructed empty
+ * with its slot and destructed with it.
+ */
+template <typename Courses>
+class StudentStore
+{
+public:
+    // The size and the alignment of a chunk.
+    static const std::size_t CHUNK_BYTES = std::size_t(1) << 16;
+
+    static const int SLOTS_PER_CHUNK = int((CHUNK_BYTES - sizeof(Courses) - sizeof(void*)) /
+                                           (3 * sizeof(int) + sizeof(Courses)));
+
+private:
+    struct Chunk {
+        // What operator new returned, the chunk starts at the first
+        // multiple of CHUNK_BYTES in it.
+        void* memory;
+        int number;
+        int ids[SLOTS_PER_CHUNK];
+        int points[SLOTS_PER_CHUNK];
+        int courseCounts[SLOTS_PER_CHUNK];
+        // Constructed only in live slots.
+        alignas(Courses) unsigned char courses[SLOTS_PER_CHUNK][sizeof(Courses)];
+    };
+
+    static_assert(sizeof(Chunk) <= CHUNK_BYTES, "a chunk must fit its alignment");
+
+    Chunk** chunks;
+    int chunkCount;
+    int chunkCapacity;
+    int slotCount;  // slots ever handed out, the rest of the last chunk is untouched.
+    int freeSlot;   // head of the free list, -1 if it is empty.
+    int liveCount;
+
+    static Chunk* chunkOf(const StudentHandle student) {
+        return reinterpret_cast<Chunk*>(reinterpret_cast<std::uintptr_t>(student.id) &
+                                        ~(std::uintptr_t(CHUNK_BYTES) - 1));
+    }
+
+    static int indexOf(const StudentHandle student) {
+        return int(student.id - chunkOf(student)->ids);
+    }
+
+    static Courses* coursesAt(Chunk* chunk, const int index) {
+        return reinterpret_cast<Courses*>(chunk->courses[index]);
+    }
+
+    // Make room for one more slot at slotCount.
+    // @throws std::bad_alloc with nothing changed.
+    void grow() {
+        if (chunkCount == chunkCapacity) {
+            const int capacity = chunkCapacity > 0 ? 2 * chunkCapacity : 4;
+            Chunk** larger = new Chunk*[capacity];
+            for (int i = 0; i < chunkCount; ++i) {
+                larger[i] = chunks[i];
+            }
+            delete[] chunks;
+            chunks = larger;
+            chunkCapacity = capacity;
+        }
+        // Aligned by hand, since aligned allocation is not portable to every
+        // toolchain this builds on. The slack is never touched, so systems
+        // that commit pages lazily do not back it with memory.
+        void* memory = ::operator new(CHUNK_BYTES + sizeof(Chunk));
+        const std::uintptr_t aligned =
+            (reinterpret_cast<std::uintptr_t>(memory) + CHUNK_BYTES - 1) &
+            ~(std::uintptr_t(CHUNK_BYTES) - 1);
+        Chunk* chunk = reinterpret_cast<Chunk*>(aligned);
+        chunk->memory = memory;
+        chunk->number = chunkCount;
+        chunks[chunkCount++] = chunk;
+    }
+
+public:
+    StudentStore()
+        : chunks(nullptr), chunkCount(0), chunkCapacity(0), slotCount(0), freeSlot(-1),
+          liveCount(0) {}
+
+    StudentStore(const StudentStore&) = delete;
+    StudentStore& operator=(const StudentStore&) = delete;
+
+    ~StudentStore() {
+        clear([](StudentHandle) {});
+        for (int i = 0; i < chunkCount; ++i) {
+            ::operator delete(chunks[i]->memory);
+        }
+        delete[] chunks;
+    }
+
+    /**
+     * @brief Create a student in a free slot, or in a new one.
+     *
+     * @param id The student id, positive.
+     * @param points The stored points.
+     * @return The handle of the student, with no courses.
+     * @throws std::bad_alloc with the store unchanged.
+     */
+    StudentHandle create(const int id, const int points) {
+        int slot = freeSlot;
+        if (slot < 0) {
+            if (slotCount == chunkCount * SLOTS_PER_CHUNK) {
+                grow();
+            }
+            slot = slotCount++;
+        }
+        Chunk* chunk = chunks[slot / SLOTS_PER_CHUNK];
+        const int index = slot % SLOTS_PER_CHUNK;
+        if (slot == freeSlot) {
+            freeSlot = ~chunk->ids[index];
+        }
+        chunk->ids[index] = id;
+        chunk->points[index] = points;
+        chunk->courseCounts[index] = 0;
+        new (chunk->courses[index]) Courses();
+        liveCount++;
+        return StudentHandle(&chunk->ids[index]);
+    }
+
+    /**
+     * @brief Destroy a student and put its slot on the free list.
+     */
+    void destroy(const StudentHandle student) {
+        Chunk* chunk = chunkOf(student);
+        const int index = indexOf(student);
+        coursesAt(chunk, index)->~Courses();
+        chunk->ids[index] = ~freeSlot;
+        freeSlot = chunk->number * SLOTS_PER_CHUNK + index;
+        liveCount--;
+    }
+
+    /**
+     * @brief Destroy every student, handing each one to dispose first. The
+     * chunks are kept for the students created next.
+     */
+    template <typename Dispose>
+    void clear(Dispose dispose) {
+        for (int slot = 0; slot < slotCount; ++slot) {
+            Chunk* chunk = chunks[slot / SLOTS_PER_CHUNK];
+            const int index = slot % SLOTS_PER_CHUNK;
+            if (chunk->ids[index] > 0) {
+                dispose(StudentHandle(&chunk->ids[index]));
+                coursesAt(chunk, index)->~Courses();
+            }
+        }
+        slotCount = 0;
+        freeSlot = -1;
+        liveCount = 0;
+    }
+
+    // Fields of a live student:
+
+    int id(const StudentHandle student) const {
+        return *student.id;
+    }
+
+    int& points(const StudentHandle student) {
+        return chunkOf(student)->points[indexOf(student)];
+    }
+
+    int points(const StudentHandle student) const {
+        return chunkOf(student)->points[indexOf(student)];
+    }
+
+    int& courseCount(const StudentHandle student) {
+        return chunkOf(student)->courseCounts[indexOf(student)];
+    }
+
+    int courseCount(const StudentHandle student) const {
+        return chunkOf(student)->courseCounts[indexOf(student)];
+    }
+
+    Courses& courses(const StudentHandle student) {
+        return *coursesAt(chunkOf(student), indexOf(student));
+    }
+
+    const Courses& courses(const StudentHandle student) const {
+        return *coursesAt(chunkOf(student), indexOf(student));
+    }
+
+    // The dense slot number of a live student.
+    int slotOf(const StudentHandle student) const {
+        return chunkOf(student)->number * SLOTS_PER_CHUNK + indexOf(student);
+    }
+
+    int size() const {
+        return liveCount;
+    }
+
+    // Columns, for scans that stream one field of every slot. Chunk c
+    // holds slots c * SLOTS_PER_CHUNK on, of which slotsIn(c) were ever
+    // used. Free slots have ids <= 0 and meaningless other fields.
+
+    int chunksUsed() const {
+        return (slotCount + SLOTS_PER_CHUNK - 1) / SLOTS_PER_CHUNK;
+    }
+
+    int slotsIn(const int chunk) const {
+        const int rest = slotCount - chunk * SLOTS_PER_CHUNK;
+        return rest < SLOTS_PER_CHUNK ? rest : SLOTS_PER_CHUNK;
+    }
+
+    const int* idColumn(const int chunk) const {
+        return chunks[chunk]->ids;
+    }
+
+    int* pointsColumn(const int chunk) {
+        return chunks[chunk]->points;
+    }
+
+    const int* pointsColumn(const int chunk) const {
+        return chunks[chunk]->points;
+    }
+
+    const int* courseCountColumn(const int chunk) const {
+        return chunks[chunk]->courseCounts;
+    }
+};
+
+#endif //STUDENTSTORE_H
@@ -2,152 +2,965 @@
 // However you need to implement all public StudentCourseManager function, as provided below as a template
 
 #include "TechSystem26a1.h"
+#include "SnapshotFile.h"
+#include "profiling.h"
 
-int TechSystem::Student::bonusPoints = 0;
+#include <climits>
 
-TechSystem::TechSystem() = default;
+TechSystem::TechSystem() : bonusPoints(0), courseBonusTotal(0) {}
 
-TechSystem::~TechSystem() = default;
+TechSystem::~TechSystem()
+{
+    clearRecords();
+}
+
+void TechSystem::clearRecords()
+{
+    // The indexes only hold handles, so release the records through their
+    // stores. The student store also frees the students' course lists.
+    ObjectPool<Course>& courses = this->courseRecords;
+    this->courseSystem.clear([&courses](Course* course) {
+        courses.destroy(course);
+    });
+    this->studentSystem.clear([](StudentHandle) {});
+    this->studentTable.clear([](StudentHandle) {});
+    this->leaderboard.clear([](Standing) {});
+    this->studentRecords.clear([](StudentHandle) {});
+    this->courseBonusTotal = 0;
+}
+
+int TechSystem::pendingPoints(const StudentHandle student) const
+{
+    if (this->courseBonusTotal == 0) {
+        return 0;
+    }
+    int pending = 0;
+    const EnrollmentIndex& enrolled = this->studentRecords.courses(student);
+    for (EnrollmentIndex::Iterator it = enrolled.begin(); it != enrolled.end(); ++it) {
+        pending += it->pending();
+    }
+    return pending;
+}
+
+void TechSystem::credit(const StudentHandle student, const int points)
+{
+    if (points == 0) {
+        return;
+    }
+    int& stored = this->studentRecords.points(student);
+    this->leaderboard.tryRemove(Standing(stored, *student));
+    stored += points;
+    // Reuses the pool node the remove just freed, so it cannot fail.
+    this->leaderboard.tryInsert(Standing(stored, *student));
+}
+
+// Expected failures (duplicate ids, missing keys) are reported by the
+// tree's try* methods, so only allocation failures are still exceptions.
 
 StatusType TechSystem::addStudent(const int studentId)
 {
-    //PROFILE_SCOPE("addStudent");
+    PROFILE_SCOPE("addStudent");
     if (studentId <= 0) {return StatusType::INVALID_INPUT;}
+    StudentHandle student;
     try {
-        this->studentSystem.insert(std::make_shared<Student>(studentId));
+        // A duplicate id only costs recycling the store slot.
+        student = this->studentRecords.create(studentId, -bonusPoints);
+        if (this->studentTable.tryInsert(student) != TreeResult::SUCCESS) {
+            this->studentRecords.destroy(student);
+            return StatusType::FAILURE;
+        }
+        // The id is new, so the ordered indexes can only fail to allocate.
+        try {
+            this->studentSystem.tryInsert(student);
+            this->leaderboard.tryInsert(Standing(-bonusPoints, studentId));
+        } catch (std::bad_alloc&) {
+            this->studentSystem.tryRemove(studentId);
+            this->studentTable.tryRemove(studentId);
+            throw;
+        }
         return StatusType::SUCCESS;
     } catch (std::bad_alloc&) {
+        if (student != StudentHandle()) {
+            this->studentRecords.destroy(student);
+        }
         return StatusType::ALLOCATION_ERROR;
-    } catch (...) {
-        return StatusType::FAILURE;
     }
-    return StatusType::FAILURE;
 }
 
 StatusType TechSystem::removeStudent(const int studentId)
 {
-    //PROFILE_SCOPE("removeStudent");
+    PROFILE_SCOPE("removeStudent");
     if (studentId <= 0) {return StatusType::INVALID_INPUT;}
-    try {
-        if (this->studentSystem.find(studentId)->numOfCourses > 0) {
-            return StatusType::FAILURE;
-        }
-        this->studentSystem.remove(studentId);
-        return StatusType::SUCCESS;
-    } catch (std::bad_alloc&) {
-        return StatusType::ALLOCATION_ERROR;
-    } catch (...) {
+    const StudentHandle* studentPtr = this->studentTable.tryFind(studentId);
+    if (studentPtr == nullptr || this->studentRecords.courseCount(*studentPtr) > 0) {
         return StatusType::FAILURE;
     }
-    return StatusType::FAILURE;
+    const StudentHandle student = *studentPtr;
+    this->studentTable.tryRemove(studentId);
+    this->studentSystem.tryRemove(studentId);
+    this->leaderboard.tryRemove(Standing(this->studentRecords.points(student), studentId));
+    this->studentRecords.destroy(student);
+    return StatusType::SUCCESS;
 }
 
 StatusType TechSystem::addCourse(const int courseId, const int points)
 {
-    //PROFILE_SCOPE("addCourse");
+    PROFILE_SCOPE("addCourse");
     if (courseId <= 0 || points <= 0) {return StatusType::INVALID_INPUT;}
+    Course* course = nullptr;
     try {
-        this->courseSystem.insert(std::make_shared<Course>(courseId, points));
+        // A duplicate id only costs recycling the pool slot.
+        course = this->courseRecords.create(courseId, points);
+        if (this->courseSystem.tryInsert(course) != TreeResult::SUCCESS) {
+            this->courseRecords.destroy(course);
+            return StatusType::FAILURE;
+        }
         return StatusType::SUCCESS;
     } catch (std::bad_alloc&) {
+        if (course != nullptr) {
+            this->courseRecords.destroy(course);
+        }
         return StatusType::ALLOCATION_ERROR;
-    } catch (...) {
-        return StatusType::FAILURE;
     }
-    return StatusType::FAILURE;
 }
 
 StatusType TechSystem::removeCourse(const int courseId)
 {
-    //PROFILE_SCOPE("removeCourse");
+    PROFILE_SCOPE("removeCourse");
     if (courseId <= 0) {return StatusType::INVALID_INPUT;}
+    Course* const* coursePtr = this->courseSystem.tryFind(courseId);
+    if (coursePtr == nullptr || !(*coursePtr)->students.isEmpty()) {
+        return StatusType::FAILURE;
+    }
+    Course* course = *coursePtr;
+    this->courseBonusTotal -= course->bonus;
+    this->courseSystem.tryRemove(courseId);
+    this->courseRecords.destroy(course);
+    return StatusType::SUCCESS;
+}
+
+StatusType TechSystem::removeCourse(const int courseId, const bool force,
+                                    const bool awardPoints)
+{
+    if (!force) {
+        return removeCourse(courseId);
+    }
+    if (courseId <= 0) {return StatusType::INVALID_INPUT;}
+    Course* const* coursePtr = this->courseSystem.tryFind(courseId);
+    if (coursePtr == nullptr) {
+        return StatusType::FAILURE;
+    }
+    Course* course = *coursePtr;
+    const int points = awardPoints ? course->points : 0;
+    // The roster is torn down without rebalancing, each student is visited
+    // once on the way and credited the course bonus it is still owed.
+    StudentRecords& students = this->studentRecords;
+    course->students.clear([this, &students, courseId, points](const StudentHandle student) {
+        EnrollmentIndex& enrolled = students.courses(student);
+        this->credit(student, points + enrolled.tryFind(courseId)->pending());
+        students.courseCount(student)--;
+        enrolled.tryRemove(courseId);
+    });
+    this->courseBonusTotal -= course->bonus;
+    this->courseSystem.tryRemove(courseId);
+    this->courseRecords.destroy(course);
+    return StatusType::SUCCESS;
+}
+
+StatusType TechSystem::enrollStudent(const int studentId, const int courseId)
+{
+    PROFILE_SCOPE("enrollStudent");
+    if(studentId <= 0 || courseId <= 0){return StatusType::INVALID_INPUT;}
+    Course* const* coursePtr = courseSystem.tryFind(courseId);
+    if (coursePtr == nullptr) {
+        return StatusType::FAILURE;
+    }
+    const StudentHandle* studentPtr = studentTable.tryFind(studentId);
+    if (studentPtr == nullptr) {
+        return StatusType::FAILURE;
+    }
     try {
-        if (!this->courseSystem.find(courseId)->students.isEmpty()){
+        if (!(*coursePtr)->addStudent(this->studentRecords, *studentPtr)) {
             return StatusType::FAILURE;
         }
-        this->courseSystem.remove(courseId);
         return StatusType::SUCCESS;
     } catch (std::bad_alloc&) {
         return StatusType::ALLOCATION_ERROR;
-    } catch (...) {
+    }
+}
+
+StatusType TechSystem::completeCourse(const int studentId, const int courseId)
+{
+    PROFILE_SCOPE("completeCourse");
+    if (studentId <= 0 || courseId <= 0){return StatusType::INVALID_INPUT;}
+    Course* const* coursePtr = courseSystem.tryFind(courseId);
+    if (coursePtr == nullptr) {
         return StatusType::FAILURE;
     }
-    return StatusType::FAILURE;
+    const StudentHandle* studentPtr = (*coursePtr)->students.tryFind(studentId);
+    if (studentPtr == nullptr) {
+        return StatusType::FAILURE;
+    }
+    const StudentHandle student = *studentPtr;
+    const Enrollment* enrollment = this->studentRecords.courses(student).tryFind(courseId);
+    credit(student, (*coursePtr)->points + enrollment->pending());
+    this->studentRecords.courseCount(student)--;
+    (*coursePtr)->removeStudent(this->studentRecords, student);
+    return StatusType::SUCCESS;
 }
 
-StatusType TechSystem::enrollStudent(const int studentId, const int courseId)
+StatusType TechSystem::addStudents(const int* studentIds, const int count)
 {
-    //PROFILE_SCOPE("enrollStudent");
-    if(studentId <= 0 || courseId <= 0){return StatusType::INVALID_INPUT;}
+    if (studentIds == nullptr || count < 0) {return StatusType::INVALID_INPUT;}
+    for (int i = 0; i < count; ++i) {
+        if (studentIds[i] <= 0) {return StatusType::INVALID_INPUT;}
+    }
+    StudentHandle* students = nullptr;
+    int created = 0;
     try {
-        courseSystem.find(courseId)->addStudent(studentSystem.find(studentId));
-        return StatusType::SUCCESS;
+        // With room reserved up front, the table inserts below cannot fail.
+        this->studentTable.reserve(this->studentTable.size() + count);
+        students = new StudentHandle[count > 0 ? count : 1];
+        for (; created < count; ++created) {
+            students[created] = this->studentRecords.create(studentIds[created], -bonusPoints);
+        }
+        if (this->studentSystem.insertBatch(students, count) == TreeResult::SUCCESS) {
+            // The ids are new, so the leaderboard can only fail to allocate.
+            try {
+                ScopedArray<Standing> standings(count);
+                for (int i = 0; i < count; ++i) {
+                    standings[i] = Standing(-bonusPoints, studentIds[i]);
+                }
+                this->leaderboard.insertBatch(standings.get(), count);
+            } catch (std::bad_alloc&) {
+                for (int i = 0; i < count; ++i) {
+                    this->studentSystem.tryRemove(studentIds[i]);
+                }
+                throw;
+            }
+            for (int i = 0; i < count; ++i) {
+                this->studentTable.tryInsert(students[i]);
+            }
+            delete[] students;
+            return StatusType::SUCCESS;
+        }
     } catch (std::bad_alloc&) {
+        for (int i = 0; i < created; ++i) {
+            this->studentRecords.destroy(students[i]);
+        }
+        delete[] students;
         return StatusType::ALLOCATION_ERROR;
-    } catch (...) {
-        return StatusType::FAILURE;
     }
+    // A repeated or existing id, nothing was inserted.
+    for (int i = 0; i < created; ++i) {
+        this->studentRecords.destroy(students[i]);
+    }
+    delete[] students;
     return StatusType::FAILURE;
 }
 
-StatusType TechSystem::completeCourse(const int studentId, const int courseId)
+StatusType TechSystem::addCourses(const int* courseIds, const int* points,
+                                  const int count)
 {
-    //PROFILE_SCOPE("completeCourse");
-    if (studentId <= 0 || courseId <= 0){return StatusType::INVALID_INPUT;}
+    if (courseIds == nullptr || points == nullptr || count < 0) {
+        return StatusType::INVALID_INPUT;
+    }
+    for (int i = 0; i < count; ++i) {
+        if (courseIds[i] <= 0 || points[i] <= 0) {return StatusType::INVALID_INPUT;}
+    }
+    Course** courses = nullptr;
+    int created = 0;
     try {
-        const std::shared_ptr<Course>& coursePtr =
-            courseSystem.find(courseId);
-        const std::shared_ptr<Student>& studentPtr =
-            coursePtr->students.find(studentId);
-        studentPtr->addPoints(coursePtr->points);
-        studentPtr->numOfCourses--;
-        coursePtr->removeStudent(studentPtr);
-        /*
-        std::shared_ptr<Course> coursePtr =
-                std::make_shared<Course>(courseId);
-        std::shared_ptr<Student> studentPtr =
-                std::make_shared<Student>(studentId);
-
-
-        //award the points (though we find the course and student twice,
-        //I really don't care
-
-        studentSystem.find(studentPtr)->
-        addPoints(courseSystem.find(coursePtr)->points);
-        studentSystem.find(studentPtr)->numOfCourses--;
-        courseSystem.find(coursePtr)->removeStudent(studentPtr);
-        */
-        return StatusType::SUCCESS;
+        // With room reserved up front, the table inserts below cannot fail.
+        this->courseSystem.reserve(this->courseSystem.size() + count);
+        courses = new Course*[count > 0 ? count : 1];
+        for (; created < count; ++created) {
+            courses[created] =
+                this->courseRecords.create(courseIds[created], points[created]);
+        }
     } catch (std::bad_alloc&) {
+        for (int i = 0; i < created; ++i) {
+            this->courseRecords.destroy(courses[i]);
+        }
+        delete[] courses;
         return StatusType::ALLOCATION_ERROR;
-    } catch (...) {
+    }
+    for (int inserted = 0; inserted < count; ++inserted) {
+        if (this->courseSystem.tryInsert(courses[inserted]) != TreeResult::SUCCESS) {
+            // A repeated or existing id, take the batch back out.
+            for (int i = 0; i < inserted; ++i) {
+                this->courseSystem.tryRemove(courses[i]->id);
+            }
+            for (int i = 0; i < count; ++i) {
+                this->courseRecords.destroy(courses[i]);
+            }
+            delete[] courses;
+            return StatusType::FAILURE;
+        }
+    }
+    delete[] courses;
+    return StatusType::SUCCESS;
+}
+
+StatusType TechSystem::mergeCourses(const int sourceCourseId,
+                                    const int targetCourseId)
+{
+    if (sourceCourseId <= 0 || targetCourseId <= 0 ||
+        sourceCourseId == targetCourseId) {
+        return StatusType::INVALID_INPUT;
+    }
+    Course* const* sourcePtr = courseSystem.tryFind(sourceCourseId);
+    Course* const* targetPtr = courseSystem.tryFind(targetCourseId);
+    if (sourcePtr == nullptr || targetPtr == nullptr) {
         return StatusType::FAILURE;
     }
-    return StatusType::FAILURE;
+    Course* source = *sourcePtr;
+    Course* target = *targetPtr;
+
+    // Point every moved student's enrollment at the target course. Each
+    // insert reuses the pool node the remove just freed, so nothing here
+    // allocates. Students already in the target keep their entry for it.
+    // The source bonus owed is credited, the target's counts from now on.
+    for (RosterIndex::Iterator it = source->students.begin();
+         it != source->students.end(); ++it) {
+        EnrollmentIndex& enrolled = this->studentRecords.courses(*it);
+        credit(*it, enrolled.tryFind(sourceCourseId)->pending());
+        enrolled.tryRemove(sourceCourseId);
+        enrolled.tryInsert(Enrollment(target, target->bonus));
+    }
+
+    // Rosters are joined node by node, no student is re-inserted.
+    StudentRecords& students = this->studentRecords;
+    target->students.merge(source->students, [&students](const StudentHandle student) {
+        students.courseCount(student)--;
+    });
+    return StatusType::SUCCESS;
+}
+
+StatusType TechSystem::withdrawStudent(const int studentId)
+{
+    if (studentId <= 0) {return StatusType::INVALID_INPUT;}
+    const StudentHandle* studentPtr = studentTable.tryFind(studentId);
+    if (studentPtr == nullptr) {
+        return StatusType::FAILURE;
+    }
+    credit(*studentPtr, pendingPoints(*studentPtr));
+    EnrollmentIndex& enrolled = this->studentRecords.courses(*studentPtr);
+    for (EnrollmentIndex::Iterator it = enrolled.begin(); it != enrolled.end(); ++it) {
+        (*it)->students.tryRemove(studentId);
+    }
+    enrolled.clear([](Enrollment) {});
+    this->studentRecords.courseCount(*studentPtr) = 0;
+    return StatusType::SUCCESS;
 }
 
 StatusType TechSystem::awardAcademicPoints(const int points)
 {
+    PROFILE_SCOPE("awardAcademicPoints");
     if (points <= 0) {return StatusType::INVALID_INPUT;}
+    bonusPoints += points;
+    return StatusType::SUCCESS;
+}
+
+StatusType TechSystem::awardCoursePoints(const int courseId, const int points)
+{
+    PROFILE_SCOPE("awardCoursePoints");
+    if (courseId <= 0 || points <= 0) {return StatusType::INVALID_INPUT;}
+    Course* const* coursePtr = courseSystem.tryFind(courseId);
+    if (coursePtr == nullptr) {
+        return StatusType::FAILURE;
+    }
+    (*coursePtr)->bonus += points;
+    this->courseBonusTotal += points;
+    return StatusType::SUCCESS;
+}
+
+output_t<int> TechSystem::getStudentPoints(const int studentId){
+    PROFILE_SCOPE("getStudentPoints");
+    if (studentId <= 0){return StatusType::INVALID_INPUT;}
+    const StudentHandle* studentPtr = studentTable.tryFind(studentId);
+    if (studentPtr == nullptr) {
+        return StatusType::FAILURE;
+    }
+    return studentRecords.points(*studentPtr) + bonusPoints + pendingPoints(*studentPtr);
+}
+
+output_t<int> TechSystem::getStudentRank(const int studentId)
+{
+    if (studentId <= 0) {return StatusType::INVALID_INPUT;}
+    if (studentTable.tryFind(studentId) == nullptr) {
+        return StatusType::FAILURE;
+    }
+    return studentSystem.rank(studentId) + 1;
+}
+
+output_t<int> TechSystem::getStudentByRank(const int rank)
+{
+    if (rank <= 0) {return StatusType::INVALID_INPUT;}
+    const StudentHandle* studentPtr = studentSystem.select(rank - 1);
+    if (studentPtr == nullptr) {
+        return StatusType::FAILURE;
+    }
+    return **studentPtr;
+}
+
+output_t<int> TechSystem::countStudentsInRange(const int lowId, const int highId)
+{
+    if (lowId <= 0 || highId < lowId) {return StatusType::INVALID_INPUT;}
+    return studentSystem.countInRange(lowId, highId);
+}
+
+output_t<int> TechSystem::getCourseStudentRank(const int courseId,
+                                               const int studentId)
+{
+    if (courseId <= 0 || studentId <= 0) {return StatusType::INVALID_INPUT;}
+    Course* const* coursePtr = courseSystem.tryFind(courseId);
+    if (coursePtr == nullptr ||
+        (*coursePtr)->students.tryFind(studentId) == nullptr) {
+        return StatusType::FAILURE;
+    }
+    return (*coursePtr)->students.rank(studentId) + 1;
+}
+
+output_t<int> TechSystem::getCourseStudentByRank(const int courseId,
+                                                 const int rank)
+{
+    if (courseId <= 0 || rank <= 0) {return StatusType::INVALID_INPUT;}
+    Course* const* coursePtr = courseSystem.tryFind(courseId);
+    if (coursePtr == nullptr) {
+        return StatusType::FAILURE;
+    }
+    const StudentHandle* studentPtr = (*coursePtr)->students.select(rank - 1);
+    if (studentPtr == nullptr) {
+        return StatusType::FAILURE;
+    }
+    return **studentPtr;
+}
+
+output_t<int> TechSystem::countCourseStudentsInRange(const int courseId,
+                                                     const int lowId,
+                                                     const int highId)
+{
+    if (courseId <= 0 || lowId <= 0 || highId < lowId) {
+        return StatusType::INVALID_INPUT;
+    }
+    Course* const* coursePtr = courseSystem.tryFind(courseId);
+    if (coursePtr == nullptr) {
+        return StatusType::FAILURE;
+    }
+    return (*coursePtr)->students.countInRange(lowId, highId);
+}
+
+output_t<int> TechSystem::getCourseRoster(const int courseId, const int fromId,
+                                          int* const studentIds,
+                                          const int capacity)
+{
+    if (courseId <= 0 || fromId < 0 || studentIds == nullptr || capacity < 0) {
+        return StatusType::INVALID_INPUT;
+    }
+    Course* const* coursePtr = courseSystem.tryFind(courseId);
+    if (coursePtr == nullptr) {
+        return StatusType::FAILURE;
+    }
+    const RosterIndex& roster = (*coursePtr)->students;
+    int written = 0;
+    for (RosterIndex::Iterator it = roster.lowerBound(fromId);
+         written < capacity && it != roster.end(); ++it) {
+        studentIds[written++] = **it;
+    }
+    return written;
+}
+
+output_t<int> TechSystem::getStudentsPoints(const int fromId,
+                                            int* const studentIds,
+                                            int* const points,
+                                            const int capacity)
+{
+    if (fromId < 0 || studentIds == nullptr || points == nullptr || capacity < 0) {
+        return StatusType::INVALID_INPUT;
+    }
+    int written = 0;
+    for (StudentIndex::Iterator it = studentSystem.lowerBound(fromId);
+         written < capacity && it != studentSystem.end(); ++it) {
+        studentIds[written] = **it;
+        points[written] = studentRecords.points(*it) + bonusPoints + pendingPoints(*it);
+        ++written;
+    }
+    return written;
+}
+
+// Leaderboard:
+
+int TechSystem::listLeaders(const int minPoints, int* const studentIds,
+                            int* const points, const int capacity) const
+{
+    // Students come in stored points order, each one at most the owed
+    // course bonuses away from its place by points. Those are placed by
+    // insertion, and the walk ends once no later student can still place.
+    int written = 0;
+    for (Leaderboard::Iterator it = leaderboard.begin(); it != leaderboard.end(); ++it) {
+        const long long most = (long long)it->points + bonusPoints + courseBonusTotal;
+        if (most < minPoints) {
+            break;
+        }
+        if (written == capacity &&
+            (courseBonusTotal == 0 || capacity == 0 || most < points[capacity - 1])) {
+            break;
+        }
+        const int owed = courseBonusTotal == 0 ? 0 : pendingPoints(*studentTable.tryFind(it->id));
+        const int effective = it->points + bonusPoints + owed;
+        if (effective < minPoints) {
+            continue;
+        }
+        int at = written;
+        while (at > 0 && (points[at - 1] < effective ||
+                          (points[at - 1] == effective && studentIds[at - 1] > it->id))) {
+            --at;
+        }
+        if (at == capacity) {
+            continue;
+        }
+        for (int i = written < capacity ? written : capacity - 1; i > at; --i) {
+            studentIds[i] = studentIds[i - 1];
+            points[i] = points[i - 1];
+        }
+        studentIds[at] = it->id;
+        points[at] = effective;
+        if (written < capacity) {
+            ++written;
+        }
+    }
+    return written;
+}
+
+output_t<int> TechSystem::getTopStudents(const int count, int* const studentIds,
+                                         int* const points)
+{
+    if (count < 0 || studentIds == nullptr || points == nullptr) {
+        return StatusType::INVALID_INPUT;
+    }
+    return listLeaders(INT_MIN, studentIds, points, count);
+}
+
+output_t<int> TechSystem::getStudentsWithPoints(const int minPoints, int* const studentIds,
+                                                int* const points, const int capacity)
+{
+    if (studentIds == nullptr || points == nullptr || capacity < 0) {
+        return StatusType::INVALID_INPUT;
+    }
+    return listLeaders(minPoints, studentIds, points, capacity);
+}
+
+output_t<int> TechSystem::countStudentsWithPoints(const int minPoints)
+{
+    // Students stored at least this far up qualify whatever they are owed.
+    const long long stored = (long long)minPoints - bonusPoints;
+    if (stored > INT_MAX) {
+        return 0;
+    }
+    if (stored <= INT_MIN) {
+        return this->leaderboard.size();
+    }
+    // Everyone ahead of the last place below stored, by rank.
+    const Standing below(int(stored - 1), 0);
+    int count = this->leaderboard.rank(below);
+    for (Leaderboard::Iterator it = this->leaderboard.lowerBound(below);
+         it != this->leaderboard.end() && it->points + courseBonusTotal >= stored; ++it) {
+        if ((long long)it->points + pendingPoints(*studentTable.tryFind(it->id)) >= stored) {
+            ++count;
+        }
+    }
+    return count;
+}
+
+// Batched commands:
+
+// The student and course a command reads or writes, nullptr for none.
+// Non-positive ids are rejected as invalid input and touch nothing.
+static const int* commandStudent(const TechSystem::Command& command)
+{
+    switch (command.opcode) {
+        case TechSystem::Opcode::ADD_STUDENT:
+        case TechSystem::Opcode::REMOVE_STUDENT:
+        case TechSystem::Opcode::ENROLL_STUDENT:
+        case TechSystem::Opcode::COMPLETE_COURSE:
+        case TechSystem::Opcode::GET_STUDENT_POINTS:
+            return command.first > 0 ? &command.first : nullptr;
+        default:
+            return nullptr;
+    }
+}
+
+static const int* commandCourse(const TechSystem::Command& command)
+{
+    switch (command.opcode) {
+        case TechSystem::Opcode::ADD_COURSE:
+        case TechSystem::Opcode::REMOVE_COURSE:
+            return command.first > 0 ? &command.first : nullptr;
+        case TechSystem::Opcode::ENROLL_STUDENT:
+        case TechSystem::Opcode::COMPLETE_COURSE:
+            return command.second > 0 ? &command.second : nullptr;
+        default:
+            return nullptr;
+    }
+}
+
+// Whether a command reaches students or courses beyond its arguments: all
+// students, a whole roster, or every course of a student.
+static bool runsAlone(const TechSystem::Opcode opcode)
+{
+    switch (opcode) {
+        case TechSystem::Opcode::AWARD_ACADEMIC_POINTS:
+        case TechSystem::Opcode::WITHDRAW_STUDENT:
+        case TechSystem::Opcode::FORCE_REMOVE_COURSE:
+        case TechSystem::Opcode::MERGE_COURSES:
+        case TechSystem::Opcode::AWARD_COURSE_POINTS:
+            return true;
+        default:
+            return false;
+    }
+}
+
+TechSystem::CommandResult TechSystem::apply(const Command& command)
+{
+    CommandResult result = {StatusType::SUCCESS, 0};
+    switch (command.opcode) {
+        case Opcode::ADD_STUDENT:
+            result.status = this->addStudent(command.first);
+            break;
+        case Opcode::REMOVE_STUDENT:
+            result.status = this->removeStudent(command.first);
+            break;
+        case Opcode::ADD_COURSE:
+            result.status = this->addCourse(command.first, command.second);
+            break;
+        case Opcode::REMOVE_COURSE:
+            result.status = this->removeCourse(command.first);
+            break;
+        case Opcode::ENROLL_STUDENT:
+            result.status = this->enrollStudent(command.first, command.second);
+            break;
+        case Opcode::COMPLETE_COURSE:
+            result.status = this->completeCourse(command.first, command.second);
+            break;
+        case Opcode::AWARD_ACADEMIC_POINTS:
+            result.status = this->awardAcademicPoints(command.first);
+            break;
+        case Opcode::GET_STUDENT_POINTS: {
+            output_t<int> points = this->getStudentPoints(command.first);
+            result.status = points.status();
+            result.value = points.ans();
+            break;
+        }
+        case Opcode::WITHDRAW_STUDENT:
+            result.status = this->withdrawStudent(command.first);
+            break;
+        case Opcode::FORCE_REMOVE_COURSE:
+            result.status = this->removeCourse(command.first, true, command.second != 0);
+            break;
+        case Opcode::MERGE_COURSES:
+            result.status = this->mergeCourses(command.first, command.second);
+            break;
+        case Opcode::AWARD_COURSE_POINTS:
+            result.status = this->awardCoursePoints(command.first, command.second);
+            break;
+        default:
+            result.status = StatusType::INVALID_INPUT;
+            break;
+    }
+    return result;
+}
+
+StatusType TechSystem::applyBatch(const Command* const commands, const int count,
+                                  CommandResult* const results)
+{
+    if (commands == nullptr || results == nullptr || count < 0) {
+        return StatusType::INVALID_INPUT;
+    }
     try {
-        Student::bonusPoints += points;
-        return StatusType::SUCCESS;
+        // All scratch space up front, so a batch either runs whole or not at all.
+        ScopedArray<int> order(count);
+        ScopedArray<int> scratch(count);
+        HashIndex<const int*> students;
+        HashIndex<const int*> courses;
+        students.reserve(count);
+        courses.reserve(count);
+
+        // Student commands first, by student id, then course-only commands
+        // by course id, so consecutive commands walk the same tree paths.
+        const auto byKey = [commands](const int a, const int b) {
+            const int* studentA = commandStudent(commands[a]);
+            const int* studentB = commandStudent(commands[b]);
+            if ((studentA == nullptr) != (studentB == nullptr)) {
+                return studentA != nullptr;
+            }
+            const int* keyA = studentA ? studentA : commandCourse(commands[a]);
+            const int* keyB = studentB ? studentB : commandCourse(commands[b]);
+            return (keyA ? *keyA : 0) < (keyB ? *keyB : 0);
+        };
+
+        int begin = 0;
+        while (begin < count) {
+            // A run is a maximal stretch of commands sharing no student and no
+            // course, so any order gives the same results. Commands on many
+            // students or courses at once always run alone.
+            int end = begin;
+            while (end < count) {
+                const Command& command = commands[end];
+                if (runsAlone(command.opcode)) {
+                    end += end == begin;
+                    break;
+                }
+                const int* student = commandStudent(command);
+                const int* course = commandCourse(command);
+                if ((student != nullptr && students.tryFind(*student) != nullptr) ||
+                    (course != nullptr && courses.tryFind(*course) != nullptr)) {
+                    break;
+                }
+                // Room was reserved for every command, these never allocate.
+                if (student != nullptr) {
+                    students.tryInsert(student);
+                }
+                if (course != nullptr) {
+                    courses.tryInsert(course);
+                }
+                ++end;
+            }
+
+            const int length = end - begin;
+            for (int i = 0; i < length; ++i) {
+                order[i] = begin + i;
+            }
+            sortRange(order.get(), length, byKey, scratch.get());
+            for (int i = 0; i < length; ++i) {
+                const Command& command = commands[order[i]];
+                results[order[i]] = apply(command);
+                const int* student = commandStudent(command);
+                const int* course = commandCourse(command);
+                if (student != nullptr) {
+                    students.tryRemove(*student);
+                }
+                if (course != nullptr) {
+                    courses.tryRemove(*course);
+                }
+            }
+            begin = end;
+        }
     } catch (std::bad_alloc&) {
         return StatusType::ALLOCATION_ERROR;
     }
-    return StatusType::FAILURE;
+    return StatusType::SUCCESS;
 }
 
-output_t<int> TechSystem::getStudentPoints(const int studentId){
-    if (studentId <= 0){return StatusType::INVALID_INPUT;}
+// Checkpoints:
+
+StatusType TechSystem::saveSnapshot(const char* const path,
+                                    const long long logPosition) const
+{
+    if (path == nullptr) {return StatusType::INVALID_INPUT;}
     try {
-        return studentSystem.find(studentId)->points +
-            Student::bonusPoints;
-        return StatusType::SUCCESS;
-    } catch(std::bad_alloc&) {
+        // Courses in id order, the table keeps them in none.
+        const int courseCount = this->courseSystem.size();
+        ScopedArray<Course*> courses(courseCount);
+        int filled = 0;
+        this->courseSystem.forEach([&courses, &filled](Course* course) {
+            courses[filled++] = course;
+        });
+        sortRange(courses.get(), courseCount, [](const Course* a, const Course* b) {
+            return a->id < b->id;
+        });
+        int enrollments = 0;
+        for (int i = 0; i < courseCount; ++i) {
+            enrollments += courses[i]->students.size();
+        }
+
+        SnapshotWriter out;
+        if (!out.open(path)) {
+            return StatusType::FAILURE;
+        }
+        SnapshotImage::Header header = {{0, 0, 0, 0}, SnapshotImage::BYTE_ORDER_MARK,
+                                        logPosition, SnapshotImage::VERSION,
+                                        bonusPoints, this->studentSystem.size(),
+                                        courseCount, enrollments, 0};
+        for (int i = 0; i < 4; ++i) {
+            header.magic[i] = SnapshotImage::magic()[i];
+        }
+        out.putHeader(header);
+
+        // One pass over the students per array, in id order.
+        const StudentIndex::Iterator studentsEnd = this->studentSystem.end();
+        for (StudentIndex::Iterator it = this->studentSystem.begin(); it != studentsEnd; ++it) {
+            out.put(**it);
+        }
+        for (StudentIndex::Iterator it = this->studentSystem.begin(); it != studentsEnd; ++it) {
+            // Course bonuses are not saved, what each student is owed is.
+            out.put(this->studentRecords.points(*it) + pendingPoints(*it));
+        }
+        int offset = 0;
+        out.put(offset);
+        for (StudentIndex::Iterator it = this->studentSystem.begin(); it != studentsEnd; ++it) {
+            offset += this->studentRecords.courseCount(*it);
+            out.put(offset);
+        }
+        for (StudentIndex::Iterator it = this->studentSystem.begin(); it != studentsEnd; ++it) {
+            const EnrollmentIndex& enrolled = this->studentRecords.courses(*it);
+            for (EnrollmentIndex::Iterator course = enrolled.begin();
+                 course != enrolled.end(); ++course) {
+                out.put((*course)->id);
+            }
+        }
+
+        for (int i = 0; i < courseCount; ++i) {
+            out.put(courses[i]->id);
+        }
+        for (int i = 0; i < courseCount; ++i) {
+            out.put(courses[i]->points);
+        }
+        offset = 0;
+        out.put(offset);
+        for (int i = 0; i < courseCount; ++i) {
+            offset += courses[i]->students.size();
+            out.put(offset);
+        }
+        for (int i = 0; i < courseCount; ++i) {
+            const RosterIndex& roster = courses[i]->students;
+            for (RosterIndex::Iterator it = roster.begin(); it != roster.end(); ++it) {
+                out.put(**it);
+            }
+        }
+        return out.commit() ? StatusType::SUCCESS : StatusType::FAILURE;
+    } catch (std::bad_alloc&) {
         return StatusType::ALLOCATION_ERROR;
-    } catch (...) {
+    }
+}
+
+StatusType TechSystem::loadSnapshot(const char* const path, long long* const logPosition)
+{
+    if (path == nullptr) {return StatusType::INVALID_INPUT;}
+    if (!this->studentTable.isEmpty() || !this->courseSystem.isEmpty()) {
+        return StatusType::FAILURE;
+    }
+    // loadImage() sets the bonus last, so a failed load leaves it alone.
+    try {
+        MappedFile file;
+        SnapshotImage image;
+        if (file.open(path) && image.open(file.data(), file.size()) && loadImage(image)) {
+            if (logPosition != nullptr) {
+                *logPosition = image.logPosition();
+            }
+            return StatusType::SUCCESS;
+        }
+        clearRecords();
+        return StatusType::FAILURE;
+    } catch (std::bad_alloc&) {
+        clearRecords();
+        return StatusType::ALLOCATION_ERROR;
+    }
+}
+
+StatusType TechSystem::getTreeStats(TreeCounters* const studentIndex,
+                                    TreeCounters* const rosters,
+                                    TreeCounters* const enrollments) const
+{
+    if (studentIndex == nullptr || rosters == nullptr || enrollments == nullptr) {
+        return StatusType::INVALID_INPUT;
+    }
+    if (!StudentIndex::StatsPolicy::ENABLED) {return StatusType::FAILURE;}
+    *studentIndex = StudentIndex::StatsPolicy::totals();
+    *rosters = RosterIndex::StatsPolicy::totals();
+    *enrollments = EnrollmentIndex::StatsPolicy::totals();
+    return StatusType::SUCCESS;
+}
+
+StatusType TechSystem::getCourseTreeStats(const int courseId, TreeCounters* const roster) const
+{
+    if (courseId <= 0 || roster == nullptr) {return StatusType::INVALID_INPUT;}
+    Course* const* coursePtr = courseSystem.tryFind(courseId);
+    if (!RosterIndex::StatsPolicy::ENABLED || coursePtr == nullptr) {
         return StatusType::FAILURE;
     }
-    return 0;
-}
\ No newline at end of file
+    *roster = (*coursePtr)->students.stats().counters();
+    return StatusType::SUCCESS;
+}
+
+bool TechSystem::loadImage(const SnapshotImage& image)
+{
+    const int studentCount = image.studentCount();
+    const int courseCount = image.courseCount();
+    const int* studentIds = image.studentIds();
+    const int* studentCourseOffsets = image.studentCourseOffsets();
+    const int* studentCourses = image.studentCourses();
+    const int* rosterOffsets = image.rosterOffsets();
+    const int* rosters = image.rosters();
+
+    // Records in id order. The store finds every student and the course
+    // table every course, so clearRecords() can undo a later failed step.
+    ScopedArray<StudentHandle> students(studentCount);
+    ScopedArray<Course*> courses(courseCount);
+    this->studentTable.reserve(studentCount);
+    this->courseSystem.reserve(courseCount);
+    for (int i = 0; i < studentCount; ++i) {
+        students[i] = this->studentRecords.create(studentIds[i], image.studentPoints()[i]);
+        this->studentTable.tryInsert(students[i]);
+    }
+    for (int i = 0; i < courseCount; ++i) {
+        courses[i] = this->courseRecords.create(image.courseIds()[i], image.coursePoints()[i]);
+        this->courseSystem.tryInsert(courses[i]);
+    }
+    // The image keeps ids strictly increasing, so these cannot clash.
+    this->studentSystem.bulkLoad(students.get(), studentCount);
+    ScopedArray<Standing> standings(studentCount);
+    for (int i = 0; i < studentCount; ++i) {
+        standings[i] = Standing(image.studentPoints()[i], studentIds[i]);
+    }
+    this->leaderboard.insertBatch(standings.get(), studentCount);
+
+    // Enrollments from the students' side, in student id order, so every
+    // roster fills up in id order as well. Each entry is checked against
+    // the course's side on the way, which then must be used up exactly.
+    HashIndex<const int*> coursePositions;
+    coursePositions.reserve(courseCount);
+    for (int i = 0; i < courseCount; ++i) {
+        coursePositions.tryInsert(image.courseIds() + i);
+    }
+    ScopedArray<int> filled(courseCount);
+    for (int i = 0; i < courseCount; ++i) {
+        filled[i] = 0;
+    }
+    int mostCourses = 0;
+    for (int i = 0; i < studentCount; ++i) {
+        const int length = studentCourseOffsets[i + 1] - studentCourseOffsets[i];
+        mostCourses = length > mostCourses ? length : mostCourses;
+    }
+    ScopedArray<StudentHandle> rosterStudents(image.enrollmentCount());
+    ScopedArray<Enrollment> enrolled(mostCourses);
+    for (int i = 0; i < studentCount; ++i) {
+        const int begin = studentCourseOffsets[i];
+        const int length = studentCourseOffsets[i + 1] - begin;
+        for (int j = 0; j < length; ++j) {
+            const int* const* position = coursePositions.tryFind(studentCourses[begin + j]);
+            if (position == nullptr) {
+                return false;
+            }
+            const int course = int(*position - image.courseIds());
+            const int entry = rosterOffsets[course] + filled[course];
+            if (entry == rosterOffsets[course + 1] || rosters[entry] != studentIds[i]) {
+                return false;
+            }
+            ++filled[course];
+            rosterStudents[entry] = students[i];
+            enrolled[j] = Enrollment(courses[course]);
+        }
+        this->studentRecords.courses(students[i]).bulkLoad(enrolled.get(), length);
+        this->studentRecords.courseCount(students[i]) = length;
+    }
+    for (int i = 0; i < courseCount; ++i) {
+        const int begin = rosterOffsets[i];
+        if (filled[i] != rosterOffsets[i + 1] - begin) {
+            return false;
+        }
+        courses[i]->students.bulkLoad(rosterStudents.get() + begin, filled[i]);
+    }
+    bonusPoints = image.bonus();
+    return true;
+}
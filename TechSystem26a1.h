@@ -15,58 +15,75 @@
 
 #include "wet1util.h"
 #include "Tree.h"
-#include <memory>
+#include "HashIndex.h"
+#include "Pool.h"
+#include "StudentStore.h"
+#include "Standing.h"
+class SnapshotImage;
 class TechSystem {
 private:
-class Student{
-    public:
-        static int bonusPoints;
-        int id;
-        int points;
-        int numOfCourses;
-
-        Student(const int id = 0, const int points = 0) {
-            this->id = id;
-            this->points = points - bonusPoints;
-            this->numOfCourses = 0;
-        }
+class Course;
 
-        ~Student() = default;
+// Index containers. Point lookups by id go through hash tables, the
+// ordered student index and the rosters are ranked AVL Trees, which the
+// order-statistic queries, iteration and merging rely on. StudentTable and
+// CourseIndex only find, insert, remove and list by id, so either can be a
+// BPlusTree<StudentHandle> or BPlusTree<Course*> from BPlusTree.h instead.
+// The trees of each role share one set of counters when built with
+// ENABLE_TREE_STATS.
+// Students are handles into the columns of a StudentStore. The
+// leaderboard orders them once more, by stored points.
+struct StudentIndexRole;
+struct RosterRole;
+struct EnrollmentRole;
+struct LeaderboardRole;
+struct Enrollment;
+typedef HashIndex<StudentHandle> StudentTable;
+typedef Tree<StudentHandle, PoolAllocator, true, BuildTreeStats<StudentIndexRole>> StudentIndex;
+typedef HashIndex<Course*> CourseIndex;
+typedef Tree<StudentHandle, PoolAllocator, true, BuildTreeStats<RosterRole>> RosterIndex;
+typedef Tree<Enrollment, PoolAllocator, false, BuildTreeStats<EnrollmentRole>> EnrollmentIndex;
+typedef StudentStore<EnrollmentIndex> StudentRecords;
+typedef Tree<Standing, PoolAllocator, true, BuildTreeStats<LeaderboardRole>> Leaderboard;
 
-        void addPoints(const int pts) {
-            this->points += pts;
-        }
+// Added to every student's stored points of this system, so awarding
+// everyone is O(1).
+int bonusPoints;
 
-        bool operator<(const Student& other) const{
-            return this->id < other.id;
-        }
-        bool operator<(const int other) const {
-            return this->id < other;
-        }
-        bool operator>(const Student& other) const{
-            return this->id > other.id;
-        }
-        bool operator>(const int other) const {
-            return this->id > other;
-        }
-        bool operator==(const Student& other) const{
-            return this->id == other.id;
-        }
-        bool operator==(const int other) const {
-            return this->id == other;
-        }
-    explicit operator int() const { return id; }
+// An entry of a student's course list. Dereferences to the course, like
+// the other index keys, and remembers the course's bonus at enrollment:
+// the student is owed the difference to the current bonus.
+struct Enrollment {
+    Course* course;
+    int joinBonus;
+
+    explicit Enrollment(Course* const course = nullptr, const int joinBonus = 0)
+        : course(course), joinBonus(joinBonus) {}
+
+    const Course& operator*() const {
+        return *course;
+    }
+    Course* operator->() const {
+        return course;
+    }
+    int pending() const {
+        return course->bonus - joinBonus;
+    }
 };
+
 class Course{
 public:
     int id;
     int points;
-    Tree<std::shared_ptr<Student>> students;
+    // Awarded so far to every student enrolled, by awardCoursePoints.
+    int bonus;
+    // Handles of the students, the records belong to TechSystem::studentRecords.
+    RosterIndex students;
 
     explicit Course(const int id = 0, const int points = 0) {
         this->id = id;
         this->points = points;
-        this->students = Tree<std::shared_ptr<Student>>();
+        this->bonus = 0;
     }
     ~Course() = default;
 
@@ -90,19 +107,68 @@ public:
     }
     explicit operator int() const { return id; }
 
-    void addStudent (const std::shared_ptr<Student>& studentPtr) {
-        this->students.insert(studentPtr);
-        studentPtr->numOfCourses++;
+    // Returns false if the student is already enrolled in the course.
+    // @throws std::bad_alloc with nothing changed.
+    bool addStudent (StudentRecords& records, const StudentHandle student) {
+        if (this->students.tryInsert(student) != TreeResult::SUCCESS) {
+            return false;
+        }
+        try {
+            records.courses(student).tryInsert(Enrollment(this, this->bonus));
+        } catch (std::bad_alloc&) {
+            this->students.tryRemove(*student);
+            throw;
+        }
+        records.courseCount(student)++;
+        return true;
     }
 
-    void removeStudent (const std::shared_ptr<Student>& studentPtr) {
-        this->students.remove(studentPtr->id);
-        //studentPtr->numOfCourses--;
+    // Returns false if the student is not enrolled in the course. The
+    // course bonus the student is still owed is the caller's to credit.
+    bool removeStudent (StudentRecords& records, const StudentHandle student) {
+        if (this->students.tryRemove(*student) != TreeResult::SUCCESS) {
+            return false;
+        }
+        records.courses(student).tryRemove(this->id);
+        return true;
     }
 };
 
-Tree<std::shared_ptr<Student>> studentSystem = Tree<std::shared_ptr<Student>>();
-Tree<std::shared_ptr<Course>> courseSystem = Tree<std::shared_ptr<Course>>();
+// Records live in stable slots, the indexes only hold handles to them.
+StudentRecords studentRecords;
+ObjectPool<Course> courseRecords;
+
+// Every student is in both: the table answers lookups, the tree ordering.
+StudentTable studentTable;
+StudentIndex studentSystem;
+CourseIndex courseSystem;
+// Every student by stored points, which differ from the points reported
+// by the same bonusPoints for everyone, so global awards never move it.
+Leaderboard leaderboard;
+
+// The bonuses of all courses together, a bound on what any student is
+// owed. While it is 0 nobody is owed anything, and reading points skips
+// the course lists.
+long long courseBonusTotal;
+
+// The course bonuses a student is owed, in O(k) for k courses.
+int pendingPoints(StudentHandle student) const;
+
+// Add to a student's stored points, moving them on the leaderboard.
+void credit(StudentHandle student, int points);
+
+// Write up to capacity students with at least minPoints points, most
+// first, and return how many were written.
+int listLeaders(int minPoints, int* studentIds, int* points, int capacity) const;
+
+// Destroy every record and empty the indexes.
+void clearRecords();
+
+// Fill an empty system from a checked image. Returns false, with the
+// records created so far still in place, if its two sides of the
+// enrollments do not mirror each other.
+// @throws std::bad_alloc
+bool loadImage(const SnapshotImage& image);
 public:
     // <DO-NOT-MODIFY> {
     TechSystem();
@@ -126,6 +192,129 @@ public:
     output_t<int> getStudentPoints(int studentId);
 
     // } </DO-NOT-MODIFY>
+
+    // Bulk loading, all ids are added or none are. Linear time when the
+    // ids arrive sorted, e.g. when loading a whole semester at startup.
+    StatusType addStudents(const int* studentIds, int count);
+
+    StatusType addCourses(const int* courseIds, const int* points, int count);
+
+    // Move every student enrolled in the source course into the target
+    // course, e.g. when sections are consolidated. The source course stays,
+    // with an empty roster. Students enrolled in both keep one enrollment.
+    StatusType mergeCourses(int sourceCourseId, int targetCourseId);
+
+    // Remove a course. With force set an enrolled roster does not fail the
+    // call: every student is dropped, and credited the course points if
+    // awardPoints is set, in a single O(k) pass over the roster.
+    StatusType removeCourse(int courseId, bool force, bool awardPoints);
+
+    // Drop a student from every course they are enrolled in, without
+    // awarding points, in O(k log n) for k courses.
+    StatusType withdrawStudent(int studentId);
+
+    // Award points to every student currently enrolled in a course, in O(1)
+    // whatever the roster size. Students enrolling later are not awarded,
+    // and those enrolled keep the points when they complete the course,
+    // withdraw or see it removed. Reading a student's points then costs
+    // O(k) for the k courses they are enrolled in.
+    StatusType awardCoursePoints(int courseId, int points);
+
+    // Leaderboard by points, most first, ties broken by smaller id. Listing
+    // k students takes O(log n + k) and counting O(log n) while no course
+    // bonus is owed. Otherwise the students an owed course bonus could
+    // still place are checked one by one as well.
+    output_t<int> getTopStudents(int count, int* studentIds, int* points);
+
+    output_t<int> getStudentsWithPoints(int minPoints, int* studentIds, int* points,
+                                        int capacity);
+
+    output_t<int> countStudentsWithPoints(int minPoints);
+
+    // Order statistics by student id, all in O(log n). Ranks are 1-based:
+    // rank 1 is the smallest id, among all students or within a course.
+    output_t<int> getStudentRank(int studentId);
+
+    output_t<int> getStudentByRank(int rank);
+
+    output_t<int> countStudentsInRange(int lowId, int highId);
+
+    output_t<int> getCourseStudentRank(int courseId, int studentId);
+
+    output_t<int> getCourseStudentByRank(int courseId, int rank);
+
+    output_t<int> countCourseStudentsInRange(int courseId, int lowId, int highId);
+
+    // Streaming in id order, one page at a time: write up to capacity
+    // entries starting at the first id >= fromId, return how many were
+    // written. The next page starts after the last id written.
+    output_t<int> getCourseRoster(int courseId, int fromId, int* studentIds,
+                                  int capacity);
+
+    output_t<int> getStudentsPoints(int fromId, int* studentIds, int* points,
+                                    int capacity);
+
+    // Batched commands, each one mirrors the method of the same name. New
+    // opcodes go last, the values are stored in command logs.
+    enum struct Opcode {
+        ADD_STUDENT,
+        REMOVE_STUDENT,
+        ADD_COURSE,
+        REMOVE_COURSE,
+        ENROLL_STUDENT,
+        COMPLETE_COURSE,
+        AWARD_ACADEMIC_POINTS,
+        GET_STUDENT_POINTS,
+        WITHDRAW_STUDENT,
+        // removeCourse(first, true, second != 0).
+        FORCE_REMOVE_COURSE,
+        MERGE_COURSES,
+        AWARD_COURSE_POINTS
+    };
+
+    // Arguments in the order the method takes them, unused ones are ignored.
+    struct Command {
+        Opcode opcode;
+        int first;
+        int second;
+    };
+
+    // value holds the answer of GET_STUDENT_POINTS, 0 otherwise.
+    struct CommandResult {
+        StatusType status;
+        int value;
+    };
+
+    // Run a single command through the method it names.
+    CommandResult apply(const Command& command);
+
+    // Run count commands, writing results[i] for commands[i]. The results
+    // and the final state are those of issuing the commands one by one, but
+    // commands on different students and courses run sorted by id for
+    // locality. Commands that touch a whole roster or every course of a
+    // student run alone, in order. ALLOCATION_ERROR is returned before anything ran if the
+    // scratch space cannot be allocated.
+    StatusType applyBatch(const Command* commands, int count, CommandResult* results);
+
+    // Checkpoints, in the format described in SnapshotFile.h. saveSnapshot
+    // writes the whole state, bonus included, and replaces the file at path
+    // only once the new snapshot is complete and synced. loadSnapshot fills
+    // an empty system from such a file in time linear in its size, and
+    // fails on a system that is not empty or a malformed file. logPosition
+    // is stored as is, for WriteAheadLog to know where to resume.
+    StatusType saveSnapshot(const char* path, long long logPosition = 0) const;
+
+    StatusType loadSnapshot(const char* path, long long* logPosition = nullptr);
+
+    // Structural counters of the trees, see TreeCounters in Tree.h. Fail
+    // unless built with ENABLE_TREE_STATS. getTreeStats reports the totals
+    // of every tree of each role, in every TechSystem of the process:
+    // the ordered student index, the course rosters and the students'
+    // course lists. getCourseTreeStats reports the roster of one course.
+    StatusType getTreeStats(TreeCounters* studentIndex, TreeCounters* rosters,
+                            TreeCounters* enrollments) const;
+
+    StatusType getCourseTreeStats(int courseId, TreeCounters* roster) const;
 };
 
 #endif // TechSystem26WINTER_WET1_H_
@@ -1,24 +1,221 @@
 #ifndef TREE_H
 #define TREE_H
 
+#include "Pool.h"
+#include "Sort.h"
+
+#include <atomic>
+
 // Exceptions:
 class KeyExistsException {};
 
 class KeyNotFoundException {};
 
+/**
+ * @brief Result codes of the exception-free tree operations.
+ */
+enum struct TreeResult {
+    SUCCESS,
+    KEY_EXISTS,
+    KEY_NOT_FOUND,
+    OUT_OF_ORDER, // join() keys do not fall on the right sides of the pivot.
+};
+
+/**
+  *@brief Balance data of a node, and the size of its subtree for ranked trees.
+  *@tparam Ranked Whether the subtree size is kept.
+ */
+template <bool Ranked>
+struct NodeMeta
+{
+    // AVL height stays below 64 for any tree that fits in memory.
+    unsigned char height;
+    // Number of nodes in the subtree rooted here.
+    int size;
+
+    NodeMeta() : height(1), size(1) {}
+
+    void resize(const NodeMeta* left, const NodeMeta* right) {
+        size = 1 + (left ? left->size : 0) + (right ? right->size : 0);
+    }
+};
+
+template <>
+struct NodeMeta<false>
+{
+    unsigned char height;
+
+    NodeMeta() : height(1) {}
+
+    void resize(const NodeMeta*, const NodeMeta*) {}
+};
+
+/**
+ * @brief Structural counters of a tree, see TreeStats.
+ */
+struct TreeCounters {
+    long long lookups;         // descents by key: find, insert, remove, rank, lowerBound.
+    long long comparisons;     // nodes compared with the key on those descents.
+    long long singleRotations; // LL and RR cases of rebalance.
+    long long doubleRotations; // LR and RL cases of rebalance.
+    long long allocated;       // nodes created.
+    long long freed;           // nodes destroyed.
+    int maxHeight;             // tallest the tree has been after a change.
+};
+
+/**
+ * @brief Tree instrumentation policy that records nothing. Every hook is
+ * empty and the tree inherits it as an empty base, so it costs no time and
+ * no space.
+ */
+struct NoTreeStats {
+    static const bool ENABLED = false;
+
+    void lookedUp(int) const {}
+    void rotated(bool) const {}
+    void allocated() const {}
+    void freed() const {}
+    void reached(int) const {}
+
+    TreeCounters counters() const {
+        return TreeCounters();
+    }
+
+    static TreeCounters totals() {
+        return TreeCounters();
+    }
+};
+
+/**
+ * @brief Tree instrumentation policy that counts into the tree and into
+ * totals shared by every tree with the same Tag, across all threads.
+ *
+ * The tree's own counters follow its locking, the totals are relaxed
+ * atomics, so they are only exact once no tree of the Tag is changing.
+ *
+ * @tparam Tag Any type, names a group of trees, e.g. one index role.
+ */
+template <typename Tag>
+class TreeStats {
+private:
+    struct Totals {
+        std::atomic<long long> lookups;
+        std::atomic<long long> comparisons;
+        std::atomic<long long> singleRotations;
+        std::atomic<long long> doubleRotations;
+        std::atomic<long long> allocated;
+        std::atomic<long long> freed;
+        std::atomic<int> maxHeight;
+    };
+
+    mutable TreeCounters own;
+
+    // Zero-initialized as a static of trivial type.
+    static Totals& shared() {
+        static Totals totals;
+        return totals;
+    }
+
+    static void add(std::atomic<long long>& total, const long long count) {
+        total.fetch_add(count, std::memory_order_relaxed);
+    }
+
+public:
+    static const bool ENABLED = true;
+
+    TreeStats() : own() {}
+
+    void lookedUp(const int comparisons) const {
+        own.lookups++;
+        own.comparisons += comparisons;
+        add(shared().lookups, 1);
+        add(shared().comparisons, comparisons);
+    }
+
+    void rotated(const bool twice) const {
+        if (twice) {
+            own.doubleRotations++;
+            add(shared().doubleRotations, 1);
+        } else {
+            own.singleRotations++;
+            add(shared().singleRotations, 1);
+        }
+    }
+
+    void allocated() const {
+        own.allocated++;
+        add(shared().allocated, 1);
+    }
+
+    void freed() const {
+        own.freed++;
+        add(shared().freed, 1);
+    }
+
+    void reached(const int height) const {
+        if (height <= own.maxHeight) {
+            return;
+        }
+        own.maxHeight = height;
+        std::atomic<int>& max = shared().maxHeight;
+        int seen = max.load(std::memory_order_relaxed);
+        while (seen < height && !max.compare_exchange_weak(seen, height, std::memory_order_relaxed)) {
+        }
+    }
+
+    // The counters of this tree alone.
+    TreeCounters counters() const {
+        return own;
+    }
+
+    // The counters of every tree of the Tag since the process started.
+    static TreeCounters totals() {
+        const Totals& all = shared();
+        TreeCounters counters;
+        counters.lookups = all.lookups.load(std::memory_order_relaxed);
+        counters.comparisons = all.comparisons.load(std::memory_order_relaxed);
+        counters.singleRotations = all.singleRotations.load(std::memory_order_relaxed);
+        counters.doubleRotations = all.doubleRotations.load(std::memory_order_relaxed);
+        counters.allocated = all.allocated.load(std::memory_order_relaxed);
+        counters.freed = all.freed.load(std::memory_order_relaxed);
+        counters.maxHeight = all.maxHeight.load(std::memory_order_relaxed);
+        return counters;
+    }
+};
+
+// The policy of the indexes that opt in, chosen by the build: TreeStats with
+// ENABLE_TREE_STATS (the CMake option of the same name), NoTreeStats without.
+#ifdef ENABLE_TREE_STATS
+template <typename Tag>
+using BuildTreeStats = TreeStats<Tag>;
+#else
+template <typename Tag>
+using BuildTreeStats = NoTreeStats;
+#endif
+
+/**
+ * @brief The type a tree takes to look up keys of type T, which *key must
+ * compare against with <, > and ==. Ids by default, specialize it for keys
+ * ordered by more than an id.
+ */
+template <typename T>
+struct TreeKeyTraits {
+    typedef int Key;
+};
+
 /**
   *@brief A node in a binary tree.
   *@tparam T The type of the key stored in the node.
+  *@tparam Ranked Whether the node keeps the size of its subtree.
  */
-template <typename T>
-struct Node
+template <typename T, bool Ranked = false>
+struct Node : NodeMeta<Ranked>
 {
     T key;
     Node* left;
     Node* right;
-    int height;
 
-    explicit Node(T k) : key(k), left(nullptr), right(nullptr), height(1) {}
+    explicit Node(T k) : key(k), left(nullptr), right(nullptr) {}
 };
 
 
@@ -26,43 +223,58 @@ struct Node
  * @brief A generic AVL Tree implementation.
  *
  * @tparam T The type of the keys stored in the tree.
+ * @tparam Alloc The node allocator policy, HeapAllocator or PoolAllocator.
+ * @tparam Ranked Keep subtree sizes in the nodes, which enables the
+ * order-statistic queries rank(), select() and countInRange().
+ * @tparam Stats The instrumentation policy, NoTreeStats or TreeStats.
  */
-template <typename T>
-class Tree
+template <typename T, template <typename> class Alloc = HeapAllocator, bool Ranked = false,
+          typename Stats = NoTreeStats>
+class Tree : private Stats
 {
+public:
+    // What lookups, ranks and ranges take, see TreeKeyTraits.
+    typedef typename TreeKeyTraits<T>::Key Key;
+
 private:
-    Node<T>* root;
+    typedef Alloc<Node<T, Ranked>> NodeAllocator;
+
+    // Upper bound on the height of any AVL tree that fits in memory,
+    // sizes the path stacks of insert and remove.
+    static const int MAX_HEIGHT = 64;
+    // Loads into an empty tree up to this size link from a stack buffer.
+    static const int SMALL_LOAD = 32;
+
+    Node<T, Ranked>* root;
 
     // Helper functions for AVL tree balancing:
 
-    int getHeight(const Node<T>* node) const {
+    int getHeight(const Node<T, Ranked>* node) const {
         // if node is nullptr, height is 0.
         return node ? node->height : 0;
     }
 
-    int getBalance(const Node<T>* node) const {
+    int getBalance(const Node<T, Ranked>* node) const {
         // if node is nullptr, balance is 0.
         return node ? getHeight(node->left) - getHeight(node->right) : 0;
     }
 
-    // Update the height of a node based on its children.
-    void updateHeight(Node<T>* node) {
+    // Subtree size of a node, only valid in ranked trees.
+    static int getSize(const Node<T, Ranked>* node) {
+        return node ? node->size : 0;
+    }
+
+    // Update the height (and size, in ranked trees) of a node based on its children.
+    void updateHeight(Node<T, Ranked>* node) {
         if (node != nullptr) {
             const int leftHeight = getHeight(node->left);
             const int rightHeight = getHeight(node->right);
             const int max = leftHeight > rightHeight ? leftHeight : rightHeight;
             node->height = 1 + max;
+            node->resize(node->left, node->right);
         }
     }
 
-    // Find the node with the minimum key value in the given subtree.
-    Node<T>* minValueNode(Node<T>* node) const {
-        Node<T>* current = node;
-        while (current->left != nullptr)
-            current = current->left;
-        return current;
-    }
-
     // Rotations:
 
     /**
@@ -72,9 +284,9 @@ private:
      * @param head The root of the subtree to rotate.
      * @return The new root after rotation.
      */
-    Node<T>* rightRotate(Node<T>* head) {
-        Node<T>* newRoot = head->left;
-        Node<T>* rightNode = newRoot->right;
+    Node<T, Ranked>* rightRotate(Node<T, Ranked>* head) {
+        Node<T, Ranked>* newRoot = head->left;
+        Node<T, Ranked>* rightNode = newRoot->right;
 
         // Perform rotation
         newRoot->right = head;
@@ -95,9 +307,9 @@ private:
      * @param head The root of the subtree to rotate.
      * @return The new root after rotation.
      */
-    Node<T>* leftRotate(Node<T>* head) {
-        Node<T>* newRoot = head->right;
-        Node<T>* leftNode = newRoot->left;
+    Node<T, Ranked>* leftRotate(Node<T, Ranked>* head) {
+        Node<T, Ranked>* newRoot = head->right;
+        Node<T, Ranked>* leftNode = newRoot->left;
 
         // Perform rotation
         newRoot->left = head;
@@ -117,7 +329,7 @@ private:
      * @param node The node to rebalance.
      * @return The new root of the subtree after rebalancing.
      */
-    Node<T>* rebalance(Node<T>* node) {
+    Node<T, Ranked>* rebalance(Node<T, Ranked>* node) {
         // Update the height of this ancestor node, while backtracking in the recursion.
         updateHeight(node);
 
@@ -130,8 +342,10 @@ private:
         if (balance > 1) {
             // LL case, left child is balanced or left heavy:
             if (getBalance(node->left) >= 0) {
+                Stats::rotated(false);
                 return rightRotate(node);
             } else { // LR Case, left child is right heavy:
+                Stats::rotated(true);
                 node->left = leftRotate(node->left);
                 return rightRotate(node);
             }
@@ -141,8 +355,10 @@ private:
         if (balance < -1) {
             // RR case, right child is balanced or right heavy:
             if (getBalance(node->right) <= 0) {
+                Stats::rotated(false);
                 return leftRotate(node);
             } else { // RL Case, right child is left heavy:
+                Stats::rotated(true);
                 node->right = rightRotate(node->right);
                 return leftRotate(node);
             }
@@ -152,123 +368,539 @@ private:
         return node;
     }
 
+    // Node allocation, through the allocator policy and counted by Stats.
+
+    // @throws std::bad_alloc
+    Node<T, Ranked>* createNode(const T& key) {
+        Node<T, Ranked>* node = NodeAllocator::create(key);
+        Stats::allocated();
+        return node;
+    }
+
+    void destroyNode(Node<T, Ranked>* node) {
+        NodeAllocator::destroy(node);
+        Stats::freed();
+    }
+
     // insertion, deletion:
 
     /**
-     * @brief Insert a key into the AVL tree rooted at node recursively.
+     * @brief Walk back up a recorded path, rebalancing every subtree on it.
      *
-     * @param node The root of the subtree where to insert the key.
-     * @param key The key to insert.
-     * @return The new root of the subtree after insertion and rebalancing.
-     * @throws KeyExistsException if the key already exists in the tree.
+     * Rebalancing stops as soon as a subtree keeps the height it had
+     * before the update, since no balance above it can have changed.
+     * Ranked trees still refresh the sizes of the remaining ancestors.
+     *
+     * @param path Links (parent child pointers or &root) from the root down.
+     * @param depth Number of links on the path.
      */
-    Node<T>* insert(Node<T>* node, const T& key) {
-        // Found null position, insert here.
-        if (node == nullptr) {
-            return new Node<T>(key);
+    void retrace(Node<T, Ranked>** path[], int depth) {
+        while (depth > 0) {
+            Node<T, Ranked>** link = path[--depth];
+            const int oldHeight = (*link)->height;
+            *link = rebalance(*link);
+            if ((*link)->height == oldHeight) {
+                break;
+            }
+        }
+        // Heights above are settled, but every ancestor's size changed.
+        if (Ranked) {
+            while (depth > 0) {
+                Node<T, Ranked>* node = *path[--depth];
+                node->resize(node->left, node->right);
+            }
         }
+    }
 
-        // Traverse the tree to find the insertion point recursively.
-        if (*key < *node->key) {
-            node->left = insert(node->left, key);
-        } else if (*key > *node->key) {
-            node->right = insert(node->right, key);
-        } else {
-            // Duplicate keys are not allowed, no memory leak here as no new node was created.
-            throw KeyExistsException();
+    /**
+     * @brief Find a node with the given key in the AVL tree rooted at node.
+     *
+     * @param node The root of the subtree to search.
+     * @param key The key to find.
+     * @return Pointer to the node with the given key, or nullptr if the key
+     * is not in the tree.
+     */
+    Node<T, Ranked>* find(Node<T, Ranked>* node, const Key& key) const {
+        int comparisons = 0;
+        while (node != nullptr) {
+            ++comparisons;
+            // Key found:
+            if (*node->key == key) {
+                Stats::lookedUp(comparisons);
+                return node;
+            }
+
+            // Traverse left or right:
+            node = *node->key > key ? node->left : node->right;
         }
 
-        // Rebalance the node if needed and return the (possibly new) root.
-        return rebalance(node);
+        // Not in tree:
+        Stats::lookedUp(comparisons);
+        return nullptr;
     }
 
-    // Delete:
-    Node<T>* remove(Node<T>* node, const int& key) {
-        // Key is not in Tree.
-        if (node == nullptr) {
-            throw KeyNotFoundException();
+    // Destroy the tree, handing every key to dispose first.
+    // Right rotations flatten the left spine, so no stack is needed.
+    template <typename Dispose>
+    void destroyTree(Node<T, Ranked>* node, Dispose& dispose) {
+        while (node != nullptr) {
+            if (node->left != nullptr) {
+                Node<T, Ranked>* left = node->left;
+                node->left = left->right;
+                left->right = node;
+                node = left;
+            } else {
+                Node<T, Ranked>* right = node->right;
+                dispose(node->key);
+                destroyNode(node);
+                node = right;
+            }
         }
+    }
 
-        // Traverse the tree to find the node to delete recursively.
-        if (*node->key > key) {
-            node->left = remove(node->left, key);
-        } else if (*node->key < key) {
-            node->right = remove(node->right, key);
-        } else { // Node with the key found.
-            // Two cases - Node with two children, or one/no child:
-
-            // Node with two children, if left and right are not nullptr:
-            if (node->left && node->right) {
-                // Get the smallest node in the right subtree:
-                Node<T>* temp = minValueNode(node->right);
-                node->key = temp->key; // Copy data, no memory problems.
-                node->right = remove(node->right, int(*temp->key)); // delete the min node.
-            } else {
-                // if we reach here, the node has at most one child.
-                // Get the non-null child, if any:
-                Node<T>* child = node->left ? node->left : node->right;
-
-                // Delete the node and return the child to link to parent.
-                Node<T>* temp = node;
-                node = child; // could be nullptr if no children.
-                delete temp; // remove the requested key.
-
-                // No need to rebalance if node is now nullptr.
-                if (node == nullptr) {
-                    return nullptr;
-                }
+    // Disposer for trees that do not own what their keys point to.
+    struct KeepKey {
+        void operator()(const T&) const {}
+    };
+
+    // Join and split:
+
+    // Smallest and largest nodes of a subtree, nullptr if it is empty.
+    Node<T, Ranked>* minNode(Node<T, Ranked>* node) const {
+        while (node != nullptr && node->left != nullptr) {
+            node = node->left;
+        }
+        return node;
+    }
+
+    Node<T, Ranked>* maxNode(Node<T, Ranked>* node) const {
+        while (node != nullptr && node->right != nullptr) {
+            node = node->right;
+        }
+        return node;
+    }
+
+    /**
+     * @brief Join two subtrees and a pivot node between them.
+     *
+     * The pivot is hung on the spine of the taller subtree at the first
+     * node no more than one level taller than the shorter subtree, then
+     * the spine is retraced as after an insert. O(height difference).
+     *
+     * @param left Subtree with keys smaller than the pivot's.
+     * @param pivot A detached node, its children are overwritten.
+     * @param right Subtree with keys larger than the pivot's.
+     * @return The root of the joined subtree.
+     */
+    Node<T, Ranked>* joinNodes(Node<T, Ranked>* left, Node<T, Ranked>* pivot, Node<T, Ranked>* right) {
+        const int leftHeight = getHeight(left);
+        const int rightHeight = getHeight(right);
+        Node<T, Ranked>** path[MAX_HEIGHT];
+        int depth = 0;
+
+        if (leftHeight > rightHeight + 1) {
+            Node<T, Ranked>** link = &left;
+            while (getHeight(*link) > rightHeight + 1) {
+                path[depth++] = link;
+                link = &(*link)->right;
             }
+            pivot->left = *link;
+            pivot->right = right;
+            updateHeight(pivot);
+            *link = pivot;
+            retrace(path, depth);
+            return left;
         }
 
-        // Rebalance the node if needed and return the (possibly new) root:
-        return rebalance(node);
+        if (rightHeight > leftHeight + 1) {
+            Node<T, Ranked>** link = &right;
+            while (getHeight(*link) > leftHeight + 1) {
+                path[depth++] = link;
+                link = &(*link)->left;
+            }
+            pivot->left = left;
+            pivot->right = *link;
+            updateHeight(pivot);
+            *link = pivot;
+            retrace(path, depth);
+            return right;
+        }
+
+        // Heights are close enough for the pivot to become the root.
+        pivot->left = left;
+        pivot->right = right;
+        updateHeight(pivot);
+        return pivot;
     }
 
     /**
-     * @brief Find a node with the given key in the AVL tree rooted at node.
+     * @brief Split a subtree around a key in O(height).
      *
-     * @param node The root of the subtree to search.
-     * @param key The key to find.
-     * @return Pointer to the node with the given key.
-     * @throws KeyNotFoundException if the key is not found in the tree.
+     * Recursion depth is bounded by the height of the subtree.
+     *
+     * @param node The root of the subtree, it is taken apart.
+     * @param key The key to split at.
+     * @param less Set to the subtree of keys smaller than key.
+     * @param greater Set to the subtree of keys larger than key.
+     * @return The detached node holding key, or nullptr if there is none.
      */
-    Node<T>* find(Node<T>* node, const int& key) const {
-        // Not in tree:
+    Node<T, Ranked>* splitNodes(Node<T, Ranked>* node, const Key& key, Node<T, Ranked>*& less,
+                        Node<T, Ranked>*& greater) {
         if (node == nullptr) {
-            throw KeyNotFoundException();
+            less = nullptr;
+            greater = nullptr;
+            return nullptr;
         }
-
-        // Key found:
+        Node<T, Ranked>* left = node->left;
+        Node<T, Ranked>* right = node->right;
         if (*node->key == key) {
+            less = left;
+            greater = right;
+            node->left = nullptr;
+            node->right = nullptr;
+            updateHeight(node);
             return node;
         }
-
-        // Traverse left or right:
         if (*node->key > key) {
-            return find(node->left, key);
-        } else {
-            return find(node->right, key);
+            Node<T, Ranked>* found = splitNodes(left, key, less, greater);
+            greater = joinNodes(greater, node, right);
+            return found;
         }
+        Node<T, Ranked>* found = splitNodes(right, key, less, greater);
+        less = joinNodes(left, node, less);
+        return found;
     }
 
-    // Destroy the tree recursively:
-    void destroyTree(Node<T>* node) {
-        if (node != nullptr) {
-            destroyTree(node->left);
-            destroyTree(node->right);
-            delete node;
+    /**
+     * @brief Union of two subtrees by splitting one at the other's root.
+     *
+     * Runs in O(m log(n/m + 1)) for subtree sizes m <= n, and reuses every
+     * node, so it cannot fail.
+     *
+     * @param kept The subtree whose keys win on duplicates.
+     * @param other The subtree merged into it.
+     * @param onDuplicate Called with a key of other that is also in kept,
+     * before its node is freed.
+     * @return The root of the union.
+     */
+    template <typename OnDuplicate>
+    Node<T, Ranked>* unionNodes(Node<T, Ranked>* kept, Node<T, Ranked>* other, OnDuplicate& onDuplicate) {
+        if (kept == nullptr) {
+            return other;
+        }
+        if (other == nullptr) {
+            return kept;
+        }
+        Node<T, Ranked>* less;
+        Node<T, Ranked>* greater;
+        Node<T, Ranked>* duplicate = splitNodes(other, Key(*kept->key), less, greater);
+        if (duplicate != nullptr) {
+            onDuplicate(duplicate->key);
+            destroyNode(duplicate);
+        }
+        Node<T, Ranked>* left = unionNodes(kept->left, less, onDuplicate);
+        Node<T, Ranked>* right = unionNodes(kept->right, greater, onDuplicate);
+        return joinNodes(left, kept, right);
+    }
+
+    // Order statistics:
+
+    // Number of keys smaller than key, or not larger if inclusive.
+    int countBelow(const Key& key, const bool inclusive) const {
+        static_assert(Ranked, "order statistics need a Ranked tree");
+        int count = 0;
+        int comparisons = 0;
+        const Node<T, Ranked>* node = root;
+        while (node != nullptr) {
+            ++comparisons;
+            if (*node->key > key || (!inclusive && *node->key == key)) {
+                node = node->left;
+            } else {
+                count += getSize(node->left) + 1;
+                node = node->right;
+            }
+        }
+        Stats::lookedUp(comparisons);
+        return count;
+    }
+
+    // Bulk building:
+
+    static bool keyLess(const T& a, const T& b) {
+        return *a < *b;
+    }
+
+    // Count the nodes of the tree by an in-order walk.
+    int countNodes() const {
+        int count = 0;
+        Node<T, Ranked>* stack[MAX_HEIGHT];
+        int depth = 0;
+        Node<T, Ranked>* node = root;
+        while (node != nullptr || depth > 0) {
+            while (node != nullptr) {
+                stack[depth++] = node;
+                node = node->left;
+            }
+            node = stack[--depth];
+            ++count;
+            node = node->right;
+        }
+        return count;
+    }
+
+    // Write the nodes of the tree to out in key order.
+    void flatten(Node<T, Ranked>** out) const {
+        Node<T, Ranked>* stack[MAX_HEIGHT];
+        int depth = 0;
+        Node<T, Ranked>* node = root;
+        while (node != nullptr || depth > 0) {
+            while (node != nullptr) {
+                stack[depth++] = node;
+                node = node->left;
+            }
+            node = stack[--depth];
+            *out++ = node;
+            node = node->right;
+        }
+    }
+
+    /**
+     * @brief Link nodes sorted by key into a perfectly balanced subtree.
+     *
+     * The two halves around the middle node differ in size by at most one,
+     * so their heights do too. Recursion depth is the height of the result.
+     *
+     * @param nodes The nodes in key order.
+     * @param count Number of nodes.
+     * @return The root of the subtree.
+     */
+    Node<T, Ranked>* link(Node<T, Ranked>* const* nodes, const int count) {
+        if (count == 0) {
+            return nullptr;
         }
+        const int mid = count / 2;
+        Node<T, Ranked>* node = nodes[mid];
+        node->left = link(nodes, mid);
+        node->right = link(nodes + mid + 1, count - mid - 1);
+        updateHeight(node);
+        return node;
+    }
+
+    /**
+     * @brief Build the empty tree from strictly increasing keys.
+     *
+     * @param nodes Room for count nodes.
+     * @throws std::bad_alloc with the tree still empty.
+     */
+    void buildSorted(const T* keys, const int count, Node<T, Ranked>** nodes) {
+        int created = 0;
+        try {
+            for (; created < count; ++created) {
+                nodes[created] = createNode(keys[created]);
+            }
+        } catch (...) {
+            for (int i = 0; i < created; ++i) {
+                destroyNode(nodes[i]);
+            }
+            throw;
+        }
+        root = link(nodes, count);
+    }
+
+    /**
+     * @brief Merge strictly increasing keys into the tree and rebuild it
+     * balanced, in time linear in the old and new sizes together.
+     *
+     * Existing nodes are relinked, only the new keys get new nodes.
+     *
+     * @param keys The new keys, strictly increasing.
+     * @param count Number of new keys.
+     * @return SUCCESS, or KEY_EXISTS if a key is already in the tree, in
+     * which case the tree is unchanged.
+     * @throws std::bad_alloc with the tree unchanged.
+     */
+    TreeResult mergeSorted(const T* keys, const int count) {
+        if (root == nullptr) {
+            if (count > SMALL_LOAD) {
+                ScopedArray<Node<T, Ranked>*> nodes(count);
+                buildSorted(keys, count, nodes.get());
+            } else {
+                Node<T, Ranked>* nodes[SMALL_LOAD];
+                buildSorted(keys, count, nodes);
+            }
+            Stats::reached(getHeight(root));
+            return TreeResult::SUCCESS;
+        }
+        const int oldCount = countNodes();
+        ScopedArray<Node<T, Ranked>*> oldNodes(oldCount);
+        flatten(oldNodes.get());
+
+        // Reject a clash before allocating anything.
+        for (int i = 0, j = 0; i < oldCount && j < count;) {
+            if (*oldNodes[i]->key < *keys[j]) {
+                ++i;
+            } else if (*keys[j] < *oldNodes[i]->key) {
+                ++j;
+            } else {
+                return TreeResult::KEY_EXISTS;
+            }
+        }
+
+        ScopedArray<Node<T, Ranked>*> merged(oldCount + count);
+        int created = 0;
+        try {
+            for (int i = 0, j = 0, out = 0; out < oldCount + count; ++out) {
+                if (j == count || (i < oldCount && *oldNodes[i]->key < *keys[j])) {
+                    merged[out] = oldNodes[i++];
+                } else {
+                    merged[out] = createNode(keys[j++]);
+                    ++created;
+                }
+            }
+        } catch (...) {
+            // Free only the new nodes, which are the ones not in the tree yet.
+            for (int i = 0, j = 0, out = 0; j < created; ++out) {
+                if (i < oldCount && merged[out] == oldNodes[i]) {
+                    ++i;
+                } else {
+                    destroyNode(merged[out]);
+                    ++j;
+                }
+            }
+            throw;
+        }
+
+        root = link(merged.get(), oldCount + count);
+        Stats::reached(getHeight(root));
+        return TreeResult::SUCCESS;
     }
 
     //----------------------------------------------------------------
 
 public:
+    typedef Stats StatsPolicy;
+
+    /**
+     * @brief Bidirectional in-order iterator.
+     *
+     * Keeps the path from the root to the current node in an inline stack,
+     * so iterating never allocates and each step is amortized O(1).
+     * Any insert or remove on the tree invalidates it.
+     */
+    class Iterator
+    {
+    private:
+        friend class Tree;
+
+        const Tree* tree;
+        Node<T, Ranked>* stack[MAX_HEIGHT];
+        int depth; // 0 means past the end.
+
+        explicit Iterator(const Tree* tree) : tree(tree), depth(0) {}
+
+        // Push node and its spine on the given side.
+        void pushSpine(Node<T, Ranked>* node, const bool leftSide) {
+            while (node != nullptr) {
+                stack[depth++] = node;
+                node = leftSide ? node->left : node->right;
+            }
+        }
+
+    public:
+        T& operator*() const {
+            return stack[depth - 1]->key;
+        }
+
+        T* operator->() const {
+            return &stack[depth - 1]->key;
+        }
+
+        // Move to the next key, or past the end after the last one.
+        Iterator& operator++() {
+            Node<T, Ranked>* node = stack[depth - 1];
+            if (node->right != nullptr) {
+                pushSpine(node->right, true);
+            } else {
+                // Climb until we leave a left subtree.
+                Node<T, Ranked>* child;
+                do {
+                    child = stack[--depth];
+                } while (depth > 0 && stack[depth - 1]->right == child);
+            }
+            return *this;
+        }
+
+        // Move to the previous key, from past the end to the last key.
+        Iterator& operator--() {
+            if (depth == 0) {
+                pushSpine(tree->root, false);
+                return *this;
+            }
+            Node<T, Ranked>* node = stack[depth - 1];
+            if (node->left != nullptr) {
+                pushSpine(node->left, false);
+            } else {
+                // Climb until we leave a right subtree.
+                Node<T, Ranked>* child;
+                do {
+                    child = stack[--depth];
+                } while (depth > 0 && stack[depth - 1]->left == child);
+            }
+            return *this;
+        }
+
+        bool operator==(const Iterator& other) const {
+            if (depth == 0 || other.depth == 0) {
+                return depth == other.depth;
+            }
+            return stack[depth - 1] == other.stack[other.depth - 1];
+        }
+
+        bool operator!=(const Iterator& other) const {
+            return !(*this == other);
+        }
+    };
+
+    /**
+     * @brief Cursor over the keys of a closed range, in increasing order.
+     *
+     * Starts at lowerBound(low) and stops after the last key <= high.
+     * Like Iterator, it is invalidated by any insert or remove.
+     */
+    class RangeCursor
+    {
+    private:
+        friend class Tree;
+
+        Iterator position;
+        Key high;
+
+        RangeCursor(const Iterator& position, const Key& high)
+            : position(position), high(high) {}
+
+    public:
+        // True once every key of the range was visited.
+        bool isDone() const {
+            return position.depth == 0 || *(*position) > high;
+        }
+
+        T& operator*() const {
+            return *position;
+        }
+
+        RangeCursor& operator++() {
+            ++position;
+            return *this;
+        }
+    };
+
     // Constructor:
     Tree() : root(nullptr) {}
 
     // Destructor:
     ~Tree() {
-        destroyTree(root);
+        KeepKey keep;
+        destroyTree(root, keep);
     }
 
     /**
@@ -278,7 +910,9 @@ public:
      * @throws KeyExistsException if the key already exists in the tree.
      */
     void insert(const T& key) {
-        root = insert(root, key);
+        if (tryInsert(key) != TreeResult::SUCCESS) {
+            throw KeyExistsException();
+        }
     }
 
     /**
@@ -287,19 +921,367 @@ public:
      * @param key The key to remove.
      * @throws KeyNotFoundException if the key is not found in the tree.
      */
-    void remove(const int key) {
-        root = remove(root, key);
+    void remove(const Key& key) {
+        if (tryRemove(key) != TreeResult::SUCCESS) {
+            throw KeyNotFoundException();
+        }
     }
 
     /**
      * @brief Public find method.
      *
      * @param key The key to find.
-     * @return Pointer to the node with the given key.
+     * @return Reference to the key stored in the tree.
      * @throws KeyNotFoundException if the key is not found in the tree.
      */
-    T& find(const int& key) const {
-        return find(root, key)->key;
+    T& find(const Key& key) const {
+        T* found = tryFind(key);
+        if (found == nullptr) {
+            throw KeyNotFoundException();
+        }
+        return *found;
+    }
+
+    /**
+     * @brief Insert a key without throwing on duplicates.
+     *
+     * @param key The key to insert.
+     * @return SUCCESS, or KEY_EXISTS if the key is already in the tree.
+     */
+    TreeResult tryInsert(const T& key) {
+        Node<T, Ranked>** path[MAX_HEIGHT];
+        int depth = 0;
+
+        // Find the null link where the key belongs.
+        Node<T, Ranked>** link = &root;
+        while (*link != nullptr) {
+            Node<T, Ranked>* node = *link;
+            path[depth++] = link;
+            if (*key < *node->key) {
+                link = &node->left;
+            } else if (*key > *node->key) {
+                link = &node->right;
+            } else {
+                // Duplicate keys are not allowed, nothing was changed.
+                Stats::lookedUp(depth);
+                return TreeResult::KEY_EXISTS;
+            }
+        }
+        Stats::lookedUp(depth);
+
+        *link = createNode(key);
+        retrace(path, depth);
+        Stats::reached(getHeight(root));
+        return TreeResult::SUCCESS;
+    }
+
+    /**
+     * @brief Remove a key without throwing if it is missing.
+     *
+     * @param key The key to remove.
+     * @return SUCCESS, or KEY_NOT_FOUND if the key is not in the tree.
+     */
+    TreeResult tryRemove(const Key& key) {
+        Node<T, Ranked>** path[MAX_HEIGHT];
+        int depth = 0;
+
+        // Find the link to the node holding the key.
+        Node<T, Ranked>** link = &root;
+        while (*link != nullptr && !(*(*link)->key == key)) {
+            Node<T, Ranked>* node = *link;
+            path[depth++] = link;
+            link = *node->key > key ? &node->left : &node->right;
+        }
+        Node<T, Ranked>* node = *link;
+        Stats::lookedUp(node == nullptr ? depth : depth + 1);
+        if (node == nullptr) {
+            return TreeResult::KEY_NOT_FOUND;
+        }
+
+        if (node->left && node->right) {
+            // Two children: the in-order successor takes the node's place.
+            path[depth++] = link;
+            const int nodeDepth = depth;
+            Node<T, Ranked>** successorLink = &node->right;
+            while ((*successorLink)->left != nullptr) {
+                path[depth++] = successorLink;
+                successorLink = &(*successorLink)->left;
+            }
+
+            // Unlink the successor and relink it where the node was.
+            Node<T, Ranked>* successor = *successorLink;
+            *successorLink = successor->right;
+            successor->left = node->left;
+            successor->right = node->right;
+            successor->height = node->height;
+            *link = successor;
+
+            // The path went through the removed node's right link.
+            if (nodeDepth < depth) {
+                path[nodeDepth] = &successor->right;
+            }
+        } else {
+            // At most one child, which replaces the node (could be nullptr).
+            *link = node->left ? node->left : node->right;
+        }
+
+        destroyNode(node);
+        retrace(path, depth);
+        return TreeResult::SUCCESS;
+    }
+
+    /**
+     * @brief Find a key without throwing if it is missing.
+     *
+     * @param key The key to find.
+     * @return Pointer to the key stored in the tree, or nullptr if not found.
+     */
+    T* tryFind(const Key& key) const {
+        Node<T, Ranked>* node = find(root, key);
+        return node ? &node->key : nullptr;
+    }
+
+    /**
+     * @brief Load keys that are already in increasing order.
+     *
+     * Builds a perfectly balanced tree in linear time without rotations.
+     * If the tree is not empty the keys are merged with its contents, in
+     * time linear in both sizes together.
+     *
+     * @param keys The keys, in strictly increasing order.
+     * @param count Number of keys.
+     * @return SUCCESS, or KEY_EXISTS if the keys are not strictly increasing
+     * or one of them is already in the tree. The tree is unchanged then.
+     * @throws std::bad_alloc with the tree unchanged.
+     */
+    TreeResult bulkLoad(const T* keys, const int count) {
+        if (count <= 0) {
+            return TreeResult::SUCCESS;
+        }
+        for (int i = 1; i < count; ++i) {
+            if (!(*keys[i - 1] < *keys[i])) {
+                return TreeResult::KEY_EXISTS;
+            }
+        }
+        return mergeSorted(keys, count);
+    }
+
+    /**
+     * @brief Insert a batch of keys in any order.
+     *
+     * The batch is sorted, then merged with the tree in time linear in
+     * both sizes together, and the result is rebuilt perfectly balanced.
+     * Either all keys are inserted or none are.
+     *
+     * @param keys The keys.
+     * @param count Number of keys.
+     * @return SUCCESS, or KEY_EXISTS if the batch repeats a key or a key is
+     * already in the tree. The tree is unchanged then.
+     * @throws std::bad_alloc with the tree unchanged.
+     */
+    TreeResult insertBatch(const T* keys, const int count) {
+        if (count <= 0) {
+            return TreeResult::SUCCESS;
+        }
+        ScopedArray<T> sorted(count);
+        for (int i = 0; i < count; ++i) {
+            sorted[i] = keys[i];
+        }
+        sortRange(sorted.get(), count, keyLess);
+        return bulkLoad(sorted.get(), count);
+    }
+
+    /**
+     * @brief Join a pivot key and a tree of larger keys onto this tree.
+     *
+     * Runs in O(log n). Only the pivot's node is allocated, the nodes of
+     * right move over and right is left empty.
+     *
+     * @param pivot A key larger than every key of this tree.
+     * @param right A tree whose keys are all larger than the pivot.
+     * @return SUCCESS, or OUT_OF_ORDER (and nothing changes) if the keys are
+     * not ordered as required.
+     * @throws std::bad_alloc with both trees unchanged.
+     */
+    TreeResult join(const T& pivot, Tree& right) {
+        const Node<T, Ranked>* leftMax = maxNode(root);
+        const Node<T, Ranked>* rightMin = minNode(right.root);
+        if (&right == this || (leftMax != nullptr && !(*leftMax->key < *pivot)) ||
+            (rightMin != nullptr && !(*pivot < *rightMin->key))) {
+            return TreeResult::OUT_OF_ORDER;
+        }
+        Node<T, Ranked>* pivotNode = createNode(pivot);
+        root = joinNodes(root, pivotNode, right.root);
+        right.root = nullptr;
+        Stats::reached(getHeight(root));
+        return TreeResult::SUCCESS;
+    }
+
+    /**
+     * @brief Split the tree around a key in O(log n).
+     *
+     * Keys smaller than key are merged into less and keys larger than it
+     * into greater, which are usually empty. Only the key itself, if it is
+     * present, stays in this tree. No node is allocated or freed.
+     *
+     * @param key The key to split at.
+     * @param less Receives the smaller keys, a tree other than this one.
+     * @param greater Receives the larger keys, a tree other than this one.
+     * @return SUCCESS if key was in the tree, KEY_NOT_FOUND otherwise.
+     */
+    TreeResult split(const Key& key, Tree& less, Tree& greater) {
+        Node<T, Ranked>* lessRoot;
+        Node<T, Ranked>* greaterRoot;
+        root = splitNodes(root, key, lessRoot, greaterRoot);
+
+        // less and greater are distinct from this tree, which kept at most key.
+        KeepKey keep;
+        less.root = unionNodes(less.root, lessRoot, keep);
+        greater.root = unionNodes(greater.root, greaterRoot, keep);
+        less.reached(getHeight(less.root));
+        greater.reached(getHeight(greater.root));
+        return root != nullptr ? TreeResult::SUCCESS : TreeResult::KEY_NOT_FOUND;
+    }
+
+    /**
+     * @brief Move every key of other into this tree, leaving other empty.
+     *
+     * Runs in O(m log(n/m + 1)) for tree sizes m <= n by splitting and
+     * joining, and reuses the nodes of other, so it cannot fail.
+     *
+     * @param other The tree to merge in.
+     * @param onDuplicate Called on each key of other that is already in
+     * this tree, before its node is freed. This tree keeps its own key.
+     */
+    template <typename OnDuplicate>
+    void merge(Tree& other, OnDuplicate onDuplicate) {
+        if (&other == this) {
+            return;
+        }
+        root = unionNodes(root, other.root, onDuplicate);
+        other.root = nullptr;
+        Stats::reached(getHeight(root));
+    }
+
+    /**
+     * @brief Number of keys in a ranked tree, O(1).
+     */
+    int size() const {
+        static_assert(Ranked, "size() needs a Ranked tree");
+        return getSize(root);
+    }
+
+    /**
+     * @brief Rank of a key in a ranked tree, O(log n).
+     *
+     * @param key The key, which need not be in the tree.
+     * @return The number of keys smaller than key, which is the 0-based
+     * position of key if it is in the tree.
+     */
+    int rank(const Key& key) const {
+        return countBelow(key, false);
+    }
+
+    /**
+     * @brief Find the key at a position in key order in a ranked tree, O(log n).
+     *
+     * @param index 0-based position.
+     * @return Pointer to the key stored in the tree, or nullptr if index
+     * is out of range.
+     */
+    T* select(int index) const {
+        static_assert(Ranked, "select() needs a Ranked tree");
+        Node<T, Ranked>* node = root;
+        while (node != nullptr) {
+            const int leftSize = getSize(node->left);
+            if (index < leftSize) {
+                node = node->left;
+            } else if (index == leftSize) {
+                return &node->key;
+            } else {
+                index -= leftSize + 1;
+                node = node->right;
+            }
+        }
+        return nullptr;
+    }
+
+    /**
+     * @brief Count the keys in a closed range in a ranked tree, O(log n).
+     *
+     * @param low The smallest key counted.
+     * @param high The largest key counted.
+     * @return The number of keys k with low <= k <= high.
+     */
+    int countInRange(const Key& low, const Key& high) const {
+        if (high < low) {
+            return 0;
+        }
+        return countBelow(high, true) - countBelow(low, false);
+    }
+
+    // Iteration:
+
+    Iterator begin() const {
+        Iterator it(this);
+        it.pushSpine(root, true);
+        return it;
+    }
+
+    Iterator end() const {
+        return Iterator(this);
+    }
+
+    /**
+     * @brief Iterator to the first key not smaller than key, O(log n).
+     *
+     * @param key The key to search for.
+     * @return The iterator, or end() if every key is smaller.
+     */
+    Iterator lowerBound(const Key& key) const {
+        Iterator it(this);
+        int found = 0;
+        Node<T, Ranked>* node = root;
+        while (node != nullptr) {
+            it.stack[it.depth++] = node;
+            if (*node->key > key || *node->key == key) {
+                found = it.depth;
+                node = node->left;
+            } else {
+                node = node->right;
+            }
+        }
+        Stats::lookedUp(it.depth);
+        // Cut the path back to the last node that qualified.
+        it.depth = found;
+        return it;
+    }
+
+    /**
+     * @brief Cursor over the keys k with low <= k <= high, O(log n) to set up.
+     */
+    RangeCursor range(const Key& low, const Key& high) const {
+        return RangeCursor(lowerBound(low), high);
+    }
+
+    /**
+     * @brief Remove all keys from the tree.
+     *
+     * @param dispose Called on every key before its node is freed, lets
+     * the owner of the keys release the objects they refer to.
+     */
+    template <typename Dispose>
+    void clear(Dispose dispose) {
+        destroyTree(root, dispose);
+        root = nullptr;
+    }
+
+    /**
+     * @brief The instrumentation policy of the tree, counters() of a
+     * TreeStats policy are this tree's own.
+     */
+    const Stats& stats() const {
+        return *this;
     }
 
     /**
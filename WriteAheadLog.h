@@ -0,0 +1,517 @@
+#ifndef WRITEAHEADLOG_H
+#define WRITEAHEADLOG_H
+
+#include "CommandLog.h"
+#include "SnapshotFile.h"
+
+#include <cstdio>
+#include <cstring>
+#include <new>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+/**
+ * @brief An append-only log of the successful mutations of a TechSystem.
+ * Together with the latest snapshot it restores the system after a crash.
+ *
+ * The file holds a Header, then frames. A frame is one group commit: the
+ * byte size and CRC-32 of its body, then the body, CommandLog records of
+ * the mutations. A frame is written with one write() and made durable with
+ * one fdatasync(), however many records it holds. A frame cut short or
+ * garbled by a crash fails its checksum, and open() drops it and
+ * everything after it.
+ *
+ * Records are numbered by position: the header holds the position of the
+ * first record, and each record is one more than the last. checkpoint()
+ * stores the current position in the snapshot before it restarts the log,
+ * so recovery skips the records the snapshot already has, even when the
+ * crash came between the two steps.
+ *
+ * The flush policy picks when appended records become durable:
+ *   EVERY_OPERATION       before apply() returns, no acknowledged
+ *                         mutation is ever lost.
+ *   EVERY_N_OPERATIONS    once every records are pending, a crash loses
+ *                         at most every - 1 of them.
+ *   EVERY_T_MILLISECONDS  once the oldest pending record is every ms old.
+ *                         Deadlines are checked by apply() and poll(), so
+ *                         a caller that goes idle should call poll().
+ *
+ * A record is appended after its command ran, since only successful
+ * mutations are logged. Callers acknowledge a mutation once it is durable
+ * under their policy. Every mutation of a logged system has to go through
+ * apply(), or addStudents() and addCourses() for the bulk calls; calling
+ * the TechSystem directly bypasses the log.
+ */
+class WriteAheadLog
+{
+public:
+    enum struct FlushPolicy {
+        EVERY_OPERATION,
+        EVERY_N_OPERATIONS,
+        EVERY_T_MILLISECONDS
+    };
+
+    struct Header {
+        unsigned char magic[4];
+        // SnapshotImage::BYTE_ORDER_MARK as the writer saw it.
+        int byteOrder;
+        int version;
+        // Zero, so that the header has no padding of unspecified value.
+        int reserved;
+        long long firstPosition;
+    };
+
+    static const int VERSION = 1;
+
+    static const unsigned char* magic() {
+        static const unsigned char magic[4] = {'T', 'S', 'W', 'L'};
+        return magic;
+    }
+
+    // Constructor. every is the N or T of the policies that take one.
+    explicit WriteAheadLog(const FlushPolicy policy = FlushPolicy::EVERY_OPERATION,
+                           const int every = 1)
+        : policy(policy), every(every > 0 ? every : 1), file(-1), path(nullptr),
+          nextPosition(0), used(FRAME_HEADER_SIZE), pending(0), pendingSince(0),
+          commitCount(0), failed(false) {}
+
+    WriteAheadLog(const WriteAheadLog&) = delete;
+    WriteAheadLog& operator=(const WriteAheadLog&) = delete;
+
+    // Destructor. Pending records are committed first.
+    ~WriteAheadLog() {
+        if (file >= 0) {
+            commit();
+            ::close(file);
+        }
+        delete[] path;
+    }
+
+    /**
+     * @brief Open the log at path, creating it if it is missing, and replay
+     * every record from position from on into system.
+     *
+     * A torn frame at the end of the log is cut off. On failure, system
+     * keeps the records replayed so far.
+     *
+     * @param path The log file.
+     * @param system Usually a system just loaded from the snapshot that
+     * covers the records before from.
+     * @param from Position of the first record to replay.
+     * @return SUCCESS. FAILURE if the log cannot be opened or created, is
+     * not a log, does not cover from, or a record does not replay
+     * successfully. ALLOCATION_ERROR if memory ran out.
+     */
+    StatusType open(const char* const path, TechSystem& system, const long long from) {
+        if (path == nullptr || from < 0 || this->file >= 0) {
+            return StatusType::INVALID_INPUT;
+        }
+        try {
+            delete[] this->path;
+            this->path = nullptr;
+            this->path = copyOf(path);
+            struct stat info;
+            if (stat(path, &info) != 0) {
+                return create(from) ? StatusType::SUCCESS : StatusType::FAILURE;
+            }
+            long long validSize = 0;
+            const StatusType status = replay(system, from, validSize);
+            if (status != StatusType::SUCCESS) {
+                return status;
+            }
+            this->file = ::open(path, O_WRONLY | O_APPEND);
+            if (this->file < 0) {
+                return StatusType::FAILURE;
+            }
+            if (validSize < (long long)info.st_size &&
+                (ftruncate(this->file, off_t(validSize)) != 0 || fsync(this->file) != 0)) {
+                return StatusType::FAILURE;
+            }
+            return StatusType::SUCCESS;
+        } catch (std::bad_alloc&) {
+            return StatusType::ALLOCATION_ERROR;
+        }
+    }
+
+    /**
+     * @brief Run a command on system, and log it if it changed the state.
+     *
+     * @return The result of the command. Whether it was logged, and made
+     * durable as the policy says, is reported by healthy().
+     */
+    TechSystem::CommandResult apply(TechSystem& system, const TechSystem::Command& command) {
+        const TechSystem::CommandResult result = system.apply(command);
+        if (result.status == StatusType::SUCCESS && isMutation(command.opcode)) {
+            append(command);
+        } else {
+            poll();
+        }
+        return result;
+    }
+
+    /**
+     * @brief Run TechSystem::addStudents, and log one ADD_STUDENT record per
+     * student if it succeeded.
+     *
+     * The records become durable together, as the policy says for the last
+     * one. A batch too large for one frame spans several, and a crash
+     * between their writes recovers the students of the frames written, as
+     * if they had been added one by one.
+     *
+     * @return The status of addStudents.
+     */
+    StatusType addStudents(TechSystem& system, const int* const studentIds, const int count) {
+        const StatusType status = system.addStudents(studentIds, count);
+        if (status == StatusType::SUCCESS) {
+            for (int i = 0; i < count; ++i) {
+                record({TechSystem::Opcode::ADD_STUDENT, studentIds[i], 0});
+            }
+            flushByPolicy();
+        } else {
+            poll();
+        }
+        return status;
+    }
+
+    /**
+     * @brief Run TechSystem::addCourses, and log one ADD_COURSE record per
+     * course if it succeeded, as addStudents() does.
+     *
+     * @return The status of addCourses.
+     */
+    StatusType addCourses(TechSystem& system, const int* const courseIds,
+                          const int* const points, const int count) {
+        const StatusType status = system.addCourses(courseIds, points, count);
+        if (status == StatusType::SUCCESS) {
+            for (int i = 0; i < count; ++i) {
+                record({TechSystem::Opcode::ADD_COURSE, courseIds[i], points[i]});
+            }
+            flushByPolicy();
+        } else {
+            poll();
+        }
+        return status;
+    }
+
+    /**
+     * @brief Make every pending record durable, in one frame.
+     *
+     * @return false if the log failed now or before.
+     */
+    bool commit() {
+        if (failed || file < 0) {
+            return false;
+        }
+        if (pending == 0) {
+            return true;
+        }
+        const int size = used - FRAME_HEADER_SIZE;
+        const unsigned checksum = crc32(buffer + FRAME_HEADER_SIZE, size);
+        std::memcpy(buffer, &size, sizeof(size));
+        std::memcpy(buffer + sizeof(size), &checksum, sizeof(checksum));
+        if (!writeAll(file, buffer, used) || fdatasync(file) != 0) {
+            failed = true;
+            return false;
+        }
+        used = FRAME_HEADER_SIZE;
+        pending = 0;
+        ++commitCount;
+        return true;
+    }
+
+    /**
+     * @brief Commit if the oldest pending record is past its deadline.
+     *
+     * @return false if the log failed now or before.
+     */
+    bool poll() {
+        if (policy == FlushPolicy::EVERY_T_MILLISECONDS && pending > 0 &&
+            milliseconds() - pendingSince >= every) {
+            return commit();
+        }
+        return !failed;
+    }
+
+    /**
+     * @brief Save a snapshot of system and restart the log after it.
+     *
+     * The pending records are committed, the snapshot is saved with the
+     * current position, and only then is the log replaced by an empty one
+     * that starts at that position.
+     *
+     * @param system The system whose mutations this log records.
+     * @param snapshotPath Where to save the snapshot.
+     * @return SUCCESS, FAILURE if a write failed, ALLOCATION_ERROR.
+     */
+    StatusType checkpoint(const TechSystem& system, const char* const snapshotPath) {
+        if (snapshotPath == nullptr) {
+            return StatusType::INVALID_INPUT;
+        }
+        if (!commit()) {
+            return StatusType::FAILURE;
+        }
+        const StatusType status = system.saveSnapshot(snapshotPath, nextPosition);
+        if (status != StatusType::SUCCESS) {
+            return status;
+        }
+        try {
+            return restart() ? StatusType::SUCCESS : StatusType::FAILURE;
+        } catch (std::bad_alloc&) {
+            return StatusType::ALLOCATION_ERROR;
+        }
+    }
+
+    /**
+     * @brief Position of the next record, pending ones included.
+     */
+    long long position() const {
+        return nextPosition;
+    }
+
+    /**
+     * @brief Number of frames committed, one fdatasync() each.
+     */
+    long long commits() const {
+        return commitCount;
+    }
+
+    /**
+     * @brief false once a write failed. No record is accepted after that,
+     * the state has to be recovered from the files.
+     */
+    bool healthy() const {
+        return !failed && file >= 0;
+    }
+
+    static_assert(sizeof(Header) == 24, "the header must not have padding");
+
+    static bool isMutation(const TechSystem::Opcode opcode) {
+        return opcode != TechSystem::Opcode::GET_STUDENT_POINTS;
+    }
+
+private:
+    static const int FRAME_HEADER_SIZE = 8;
+    static const int BUFFER_SIZE = 1 << 16;
+
+    const FlushPolicy policy;
+    const int every;
+    int file;
+    char* path;
+    // Records are encoded against the previous ones, decoding the log on
+    // open() leaves the codec ready to append.
+    CommandLog codec;
+    long long nextPosition;
+    // The frame being built, its header is filled in by commit().
+    unsigned char buffer[BUFFER_SIZE];
+    int used;
+    int pending;
+    long long pendingSince;
+    long long commitCount;
+    bool failed;
+
+    void append(const TechSystem::Command& command) {
+        record(command);
+        flushByPolicy();
+    }
+
+    // Add a record to the frame, committing first if the frame is full.
+    void record(const TechSystem::Command& command) {
+        if (failed || file < 0) {
+            return;
+        }
+        if (used + CommandLog::MAX_COMMAND_SIZE > BUFFER_SIZE && !commit()) {
+            return;
+        }
+        if (pending == 0 && policy == FlushPolicy::EVERY_T_MILLISECONDS) {
+            pendingSince = milliseconds();
+        }
+        used += codec.encode(command, buffer + used);
+        ++pending;
+        ++nextPosition;
+    }
+
+    // Commit the pending records if the policy says they are due.
+    void flushByPolicy() {
+        if (failed || file < 0) {
+            return;
+        }
+        switch (policy) {
+            case FlushPolicy::EVERY_OPERATION:
+                commit();
+                break;
+            case FlushPolicy::EVERY_N_OPERATIONS:
+                if (pending >= every) {
+                    commit();
+                }
+                break;
+            case FlushPolicy::EVERY_T_MILLISECONDS:
+                poll();
+                break;
+        }
+    }
+
+    // Replay the frames of the existing log, validSize is set to the bytes
+    // up to the end of the last intact frame.
+    // @throws std::bad_alloc
+    StatusType replay(TechSystem& system, const long long from, long long& validSize) {
+        MappedFile log;
+        if (!log.open(path) || log.size() < (long long)sizeof(Header)) {
+            return StatusType::FAILURE;
+        }
+        Header header;
+        std::memcpy(&header, log.data(), sizeof(header));
+        if (std::memcmp(header.magic, magic(), sizeof(header.magic)) != 0 ||
+            header.byteOrder != SnapshotImage::BYTE_ORDER_MARK ||
+            header.version != VERSION || header.firstPosition > from) {
+            return StatusType::FAILURE;
+        }
+        nextPosition = header.firstPosition;
+        long long offset = sizeof(Header);
+        while (log.size() - offset >= FRAME_HEADER_SIZE) {
+            int size = 0;
+            unsigned checksum = 0;
+            std::memcpy(&size, log.data() + offset, sizeof(size));
+            std::memcpy(&checksum, log.data() + offset + sizeof(size), sizeof(checksum));
+            const unsigned char* body = log.data() + offset + FRAME_HEADER_SIZE;
+            if (size <= 0 || size > log.size() - offset - FRAME_HEADER_SIZE ||
+                crc32(body, size) != checksum) {
+                break;
+            }
+            TechSystem::Command command;
+            for (int read = 0; read < size;) {
+                const int length = codec.decode(body + read, size - read, command);
+                if (length == 0) {
+                    // The checksum matched, so this is not a torn write.
+                    return StatusType::FAILURE;
+                }
+                read += length;
+                if (nextPosition >= from) {
+                    const StatusType status = system.apply(command).status;
+                    if (status != StatusType::SUCCESS) {
+                        return status == StatusType::ALLOCATION_ERROR ?
+                               status : StatusType::FAILURE;
+                    }
+                }
+                ++nextPosition;
+            }
+            offset += FRAME_HEADER_SIZE + size;
+        }
+        validSize = offset;
+        // The snapshot must not be ahead of the log, or records are missing.
+        return nextPosition >= from ? StatusType::SUCCESS : StatusType::FAILURE;
+    }
+
+    // Start an empty log at path, first record at position first.
+    // @throws std::bad_alloc
+    bool create(const long long first) {
+        file = writeEmptyLog(path, first);
+        if (file < 0 || !syncParentDirectory(path)) {
+            return false;
+        }
+        nextPosition = first;
+        return true;
+    }
+
+    // Replace the log by an empty one starting at the current position.
+    // @throws std::bad_alloc
+    bool restart() {
+        const int length = int(std::strlen(path));
+        char* temporary = new char[length + 5];
+        std::memcpy(temporary, path, size_t(length));
+        std::memcpy(temporary + length, ".tmp", 5);
+        const int replacement = writeEmptyLog(temporary, nextPosition);
+        const bool renamed = replacement >= 0 && std::rename(temporary, path) == 0;
+        if (!renamed) {
+            if (replacement >= 0) {
+                ::close(replacement);
+            }
+            std::remove(temporary);
+            delete[] temporary;
+            failed = true;
+            return false;
+        }
+        delete[] temporary;
+        ::close(file);
+        file = replacement;
+        codec = CommandLog();
+        if (!syncParentDirectory(path)) {
+            failed = true;
+            return false;
+        }
+        return true;
+    }
+
+    // A new file at target holding only a synced header, open for appending.
+    static int writeEmptyLog(const char* target, const long long first) {
+        const int descriptor = ::open(target, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644);
+        if (descriptor < 0) {
+            return -1;
+        }
+        Header header;
+        std::memcpy(header.magic, magic(), sizeof(header.magic));
+        header.byteOrder = SnapshotImage::BYTE_ORDER_MARK;
+        header.version = VERSION;
+        header.reserved = 0;
+        header.firstPosition = first;
+        if (!writeAll(descriptor, reinterpret_cast<const unsigned char*>(&header),
+                      int(sizeof(header))) || fsync(descriptor) != 0) {
+            ::close(descriptor);
+            return -1;
+        }
+        return descriptor;
+    }
+
+    static bool writeAll(const int descriptor, const unsigned char* data, int size) {
+        while (size > 0) {
+            const ssize_t written = write(descriptor, data, size_t(size));
+            if (written <= 0) {
+                return false;
+            }
+            data += written;
+            size -= int(written);
+        }
+        return true;
+    }
+
+    // @throws std::bad_alloc
+    static char* copyOf(const char* text) {
+        const size_t length = std::strlen(text);
+        char* copy = new char[length + 1];
+        std::memcpy(copy, text, length + 1);
+        return copy;
+    }
+
+    static long long milliseconds() {
+        timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        return (long long)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+    }
+
+    // CRC-32 as used by zlib and PNG.
+    static unsigned crc32(const unsigned char* data, const int size) {
+        struct Table {
+            unsigned entries[256];
+
+            Table() {
+                for (unsigned i = 0; i < 256; ++i) {
+                    unsigned crc = i;
+                    for (int bit = 0; bit < 8; ++bit) {
+                        crc = crc & 1 ? (crc >> 1) ^ 0xEDB88320u : crc >> 1;
+                    }
+                    entries[i] = crc;
+                }
+            }
+        };
+        static const Table table;
+        unsigned crc = 0xFFFFFFFFu;
+        for (int i = 0; i < size; ++i) {
+            crc = table.entries[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+        }
+        return crc ^ 0xFFFFFFFFu;
+    }
+};
+
+#endif //WRITEAHEADLOG_H
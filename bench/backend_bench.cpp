@@ -0,0 +1,191 @@
+// Compares the AVL Tree and the BPlusTree index backends.
+//
+// Usage: backend_bench [trace file] [synthetic key count]
+//   trace file             defaults to tests/test40.in
+//   synthetic key count    defaults to 10000000
+//
+// The trace run replays the student-index traffic of a command file:
+// addStudent inserts, removeStudent removes, and every other command that
+// names a student looks it up. The synthetic run inserts, finds and
+// removes N distinct keys in random order.
+
+#include "Tree.h"
+#include "BPlusTree.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+struct Record {
+    int id;
+
+    bool operator<(const Record& other) const { return id < other.id; }
+    bool operator>(const Record& other) const { return id > other.id; }
+    bool operator==(int other) const { return id == other; }
+    bool operator>(int other) const { return id > other; }
+    explicit operator int() const { return id; }
+};
+
+enum class OpKind { INSERT, REMOVE, FIND };
+
+struct Op {
+    OpKind kind;
+    int id;
+};
+
+typedef std::chrono::steady_clock Clock;
+
+double elapsedNs(Clock::time_point start) {
+    return std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+}
+
+std::vector<Op> loadTrace(const char* path) {
+    std::vector<Op> ops;
+    std::ifstream in(path);
+    std::string command;
+    int first = 0;
+    int second = 0;
+    while (in >> command) {
+        const bool twoArgs = command == "addCourse" || command == "enrollStudent" ||
+                             command == "completeCourse";
+        in >> first;
+        if (twoArgs) {
+            in >> second;
+        }
+        if (first <= 0) {
+            continue; // rejected as invalid input before any index is touched.
+        }
+        if (command == "addStudent") {
+            ops.push_back({OpKind::INSERT, first});
+        } else if (command == "removeStudent") {
+            ops.push_back({OpKind::REMOVE, first});
+        } else if (command == "getStudentPoints" || command == "enrollStudent" ||
+                   command == "completeCourse") {
+            ops.push_back({OpKind::FIND, first});
+        }
+    }
+    return ops;
+}
+
+// Replays the trace `rounds` times on fresh indexes, returns ns per op.
+template <typename Index>
+double replayTrace(const std::vector<Op>& ops, std::vector<Record>& records, int rounds) {
+    long long checksum = 0;
+    const Clock::time_point start = Clock::now();
+    for (int round = 0; round < rounds; ++round) {
+        Index index;
+        for (const Op& op : ops) {
+            Record* record = &records[op.id];
+            switch (op.kind) {
+                case OpKind::INSERT:
+                    checksum += index.tryInsert(record) == TreeResult::SUCCESS;
+                    break;
+                case OpKind::REMOVE:
+                    checksum += index.tryRemove(op.id) == TreeResult::SUCCESS;
+                    break;
+                case OpKind::FIND:
+                    checksum += index.tryFind(op.id) != nullptr;
+                    break;
+            }
+        }
+    }
+    const double ns = elapsedNs(start);
+    if (checksum < 0) {
+        std::printf("unreachable\n");
+    }
+    return ns / (double(ops.size()) * rounds);
+}
+
+struct SyntheticResult {
+    double insertNs;
+    double findNs;
+    double removeNs;
+};
+
+template <typename Index>
+SyntheticResult runSynthetic(std::vector<Record>& records, std::vector<int> order) {
+    std::mt19937 rng(42);
+    const double count = double(order.size());
+    SyntheticResult result;
+    long long checksum = 0;
+    Index index;
+
+    std::shuffle(order.begin(), order.end(), rng);
+    Clock::time_point start = Clock::now();
+    for (int id : order) {
+        index.tryInsert(&records[id]);
+    }
+    result.insertNs = elapsedNs(start) / count;
+
+    std::shuffle(order.begin(), order.end(), rng);
+    start = Clock::now();
+    for (int id : order) {
+        checksum += (*index.tryFind(id))->id;
+    }
+    result.findNs = elapsedNs(start) / count;
+
+    std::shuffle(order.begin(), order.end(), rng);
+    start = Clock::now();
+    for (int id : order) {
+        index.tryRemove(id);
+    }
+    result.removeNs = elapsedNs(start) / count;
+
+    if (checksum < 0) {
+        std::printf("unreachable\n");
+    }
+    return result;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    const char* tracePath = argc > 1 ? argv[1] : "tests/test40.in";
+    const int count = argc > 2 ? std::atoi(argv[2]) : 10000000;
+
+    typedef Tree<Record*, PoolAllocator> Avl;
+    typedef BPlusTree<Record*, PoolAllocator> BPlus;
+
+    const std::vector<Op> ops = loadTrace(tracePath);
+    if (!ops.empty()) {
+        int maxId = 0;
+        for (const Op& op : ops) {
+            maxId = std::max(maxId, op.id);
+        }
+        std::vector<Record> records(maxId + 1);
+        for (int id = 0; id <= maxId; ++id) {
+            records[id].id = id;
+        }
+        const int rounds = std::max(1, 4000000 / int(ops.size()));
+        std::printf("trace %s: %zu student-index ops x %d rounds\n",
+                    tracePath, ops.size(), rounds);
+        std::printf("  %-8s %8.1f ns/op\n", "avl", replayTrace<Avl>(ops, records, rounds));
+        std::printf("  %-8s %8.1f ns/op\n", "bplus", replayTrace<BPlus>(ops, records, rounds));
+    } else {
+        std::printf("trace %s: no student-index ops found\n", tracePath);
+    }
+
+    if (count > 0) {
+        std::vector<Record> records(count + 1);
+        std::vector<int> order(count);
+        for (int id = 1; id <= count; ++id) {
+            records[id].id = id;
+            order[id - 1] = id;
+        }
+        std::printf("synthetic: %d random keys (ns/op)\n", count);
+        std::printf("  %-8s %8s %8s %8s\n", "backend", "insert", "find", "remove");
+        const SyntheticResult avl = runSynthetic<Avl>(records, order);
+        std::printf("  %-8s %8.1f %8.1f %8.1f\n", "avl", avl.insertNs, avl.findNs, avl.removeNs);
+        const SyntheticResult bplus = runSynthetic<BPlus>(records, order);
+        std::printf("  %-8s %8.1f %8.1f %8.1f\n", "bplus", bplus.insertNs, bplus.findNs,
+                    bplus.removeNs);
+    }
+    return 0;
+}
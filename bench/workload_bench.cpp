@@ -0,0 +1,700 @@
+// Synthetic workload benchmark for TechSystem and its Tree index.
+//
+// Usage: workload_bench [name=value ...]
+//   ops=N          operations per workload, default 1000000, at most 10000000
+//   students=N     size of the student id space, default 100000
+//   courses=N      size of the course id space, default 1000
+//   enrolled=N     courses each preloaded student starts in, default 2
+//   dist=D         uniform, zipf, sequential, adversarial or all, default all
+//   zipf=S         Zipf exponent, default 0.99
+//   mix=M          balanced, read, write or churn, default balanced, or
+//                  weights such as add:5,remove:5,enroll:40,complete:30,get:20
+//   seed=N         workload seed, default 1
+//   json=PATH      also write the results to PATH, one result per line
+//   baseline=PATH  compare with a json= file of an earlier run, exit 1 if a
+//                  p50 got slower or a throughput lower than tolerance=
+//   tolerance=P    allowed regression in percent, default 10
+//
+// A workload is generated in full before it runs, then replayed twice on
+// systems preloaded the same way: every other student id of the space, every
+// course, and `enrolled` enrollments per student. The first replay is not
+// instrumented and gives the throughput of the whole mix; the second times
+// every call and gives the latency percentiles of each operation. The
+// throughput of a single operation is 1 / mean latency and so includes the
+// timer overhead printed in the header.
+//
+// Built with ENABLE_TREE_STATS, the timed replay also prints what the trees
+// of each role did: descents, comparisons, rotations and node churn.
+//
+// The Tree run loads every student id of the space into a ranked
+// Tree<Record*, PoolAllocator, true> in the order of the distribution, then
+// times find, rank and select on sampled ids and removes everything again.
+//
+// Distributions, over both the student and the course id space:
+//   uniform      every id equally likely.
+//   zipf         the id of popularity rank r drawn with weight 1 / r^S, the
+//                ranks scattered over the id space.
+//   sequential   ids in ascending order, wrapping around.
+//   adversarial  ids a large power of two apart, visited alternately from
+//                the low and the high end: every tree insert lands on an
+//                edge of the tree, and the ids agree in their low bits.
+
+#include "TechSystem26a1.h"
+#include "Tree.h"
+
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <numeric>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+struct Record {
+    int id;
+
+    bool operator<(const Record& other) const { return id < other.id; }
+    bool operator>(const Record& other) const { return id > other.id; }
+    bool operator==(int other) const { return id == other; }
+    bool operator>(int other) const { return id > other; }
+    explicit operator int() const { return id; }
+};
+
+typedef std::chrono::steady_clock Clock;
+
+unsigned elapsedNs(Clock::time_point start, Clock::time_point end) {
+    const long long ns = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+    return ns > UINT_MAX ? UINT_MAX : unsigned(ns);
+}
+
+// Median cost of one Clock::now() call, which every timed sample includes.
+double timerOverheadNs() {
+    std::vector<unsigned> samples(1001);
+    for (unsigned& sample : samples) {
+        const Clock::time_point start = Clock::now();
+        sample = elapsedNs(start, Clock::now());
+    }
+    std::nth_element(samples.begin(), samples.begin() + 500, samples.end());
+    return samples[500];
+}
+
+enum class Dist { UNIFORM, ZIPF, SEQUENTIAL, ADVERSARIAL };
+
+const char* const DIST_NAMES[] = {"uniform", "zipf", "sequential", "adversarial"};
+
+/**
+ * @brief A space of `size` positive ids and a generator of ids from it.
+ */
+class IdSpace {
+private:
+    Dist dist;
+    std::vector<int> ids;    // id of each index.
+    std::vector<double> cdf; // zipf only, cumulative weight of ranks 0..i.
+    long long visited;       // sequential and adversarial position.
+
+    int indexAt(const long long step) const {
+        const int size = int(ids.size());
+        const int k = int(step % size);
+        if (dist == Dist::ADVERSARIAL) {
+            return k % 2 == 0 ? k / 2 : size - 1 - k / 2;
+        }
+        return k;
+    }
+
+public:
+    IdSpace(const Dist dist, const int size, const double exponent, std::mt19937_64& rng)
+        : dist(dist), ids(size), visited(0) {
+        long long stride = 1;
+        if (dist == Dist::ADVERSARIAL) {
+            while (stride * 2 * size <= INT_MAX) {
+                stride *= 2;
+            }
+        }
+        for (int i = 0; i < size; ++i) {
+            ids[i] = int((i + 1) * stride);
+        }
+        if (dist == Dist::UNIFORM || dist == Dist::ZIPF) {
+            std::shuffle(ids.begin(), ids.end(), rng);
+        }
+        if (dist == Dist::ZIPF) {
+            cdf.resize(size);
+            double total = 0;
+            for (int i = 0; i < size; ++i) {
+                total += 1.0 / std::pow(double(i + 1), exponent);
+                cdf[i] = total;
+            }
+        }
+    }
+
+    int size() const {
+        return int(ids.size());
+    }
+
+    int id(const int index) const {
+        return ids[index];
+    }
+
+    // Index of the next id the distribution produces.
+    int next(std::mt19937_64& rng) {
+        switch (dist) {
+            case Dist::UNIFORM:
+                return int(rng() % ids.size());
+            case Dist::ZIPF: {
+                const double point = std::uniform_real_distribution<double>(0, cdf.back())(rng);
+                const size_t rank = std::upper_bound(cdf.begin(), cdf.end(), point) - cdf.begin();
+                return int(std::min(rank, ids.size() - 1));
+            }
+            default:
+                return indexAt(visited++);
+        }
+    }
+
+    // Every index once, in the order the distribution would insert them.
+    std::vector<int> order(std::mt19937_64& rng) const {
+        std::vector<int> indexes(ids.size());
+        for (size_t step = 0; step < indexes.size(); ++step) {
+            indexes[step] = indexAt(step);
+        }
+        if (dist == Dist::UNIFORM || dist == Dist::ZIPF) {
+            std::shuffle(indexes.begin(), indexes.end(), rng);
+        }
+        return indexes;
+    }
+};
+
+enum OpKind { ADD, REMOVE, ENROLL, COMPLETE, GET, AWARD, OP_KINDS };
+
+const char* const OP_NAMES[OP_KINDS] = {
+    "addStudent", "removeStudent", "enrollStudent",
+    "completeCourse", "getStudentPoints", "awardAcademicPoints",
+};
+
+const std::string MIX_KEYS[OP_KINDS] = {"add", "remove", "enroll", "complete", "get", "award"};
+
+struct Op {
+    OpKind kind;
+    int first;
+    int second;
+};
+
+// Relative weights of the operation kinds, or false if spec is malformed.
+bool parseMix(const std::string& spec, int weights[OP_KINDS]) {
+    static const struct {
+        const char* name;
+        int weights[OP_KINDS];
+    } presets[] = {
+        {"balanced", {10, 5, 35, 25, 24, 1}},
+        {"read", {1, 0, 5, 4, 90, 0}},
+        {"write", {20, 10, 40, 30, 0, 0}},
+        {"churn", {45, 45, 0, 0, 10, 0}},
+    };
+    for (const auto& preset : presets) {
+        if (spec == preset.name) {
+            std::copy(preset.weights, preset.weights + OP_KINDS, weights);
+            return true;
+        }
+    }
+    std::fill(weights, weights + OP_KINDS, 0);
+    size_t start = 0;
+    while (start < spec.size()) {
+        size_t end = spec.find(',', start);
+        if (end == std::string::npos) {
+            end = spec.size();
+        }
+        const std::string item = spec.substr(start, end - start);
+        const size_t colon = item.find(':');
+        const int kind = int(std::find(MIX_KEYS, MIX_KEYS + OP_KINDS, item.substr(0, colon)) -
+                             MIX_KEYS);
+        if (colon == std::string::npos || kind == OP_KINDS) {
+            return false;
+        }
+        weights[kind] = std::atoi(item.c_str() + colon + 1);
+        if (weights[kind] < 0) {
+            return false;
+        }
+        start = end + 1;
+    }
+    return std::accumulate(weights, weights + OP_KINDS, 0) > 0;
+}
+
+/**
+ * @brief Generate the operations of a workload. A completeCourse names a
+ * pair enrolled earlier in the workload while there is one, so that most
+ * completions succeed rather than fail on a random pair.
+ */
+std::vector<Op> generate(const int count, const int weights[OP_KINDS], IdSpace& students,
+                         IdSpace& courses, std::mt19937_64& rng) {
+    static const size_t PENDING = 4096;
+    int total = 0;
+    int bounds[OP_KINDS];
+    for (int kind = 0; kind < OP_KINDS; ++kind) {
+        total += weights[kind];
+        bounds[kind] = total;
+    }
+    std::vector<Op> ops(count);
+    std::vector<std::pair<int, int>> pending;
+    pending.reserve(PENDING);
+    for (Op& op : ops) {
+        const int pick = int(rng() % total);
+        op.kind = OpKind(std::upper_bound(bounds, bounds + OP_KINDS, pick) - bounds);
+        op.second = 0;
+        if (op.kind == COMPLETE && !pending.empty()) {
+            const size_t at = rng() % pending.size();
+            op.first = pending[at].first;
+            op.second = pending[at].second;
+            pending[at] = pending.back();
+            pending.pop_back();
+        } else if (op.kind == ENROLL || op.kind == COMPLETE) {
+            op.first = students.id(students.next(rng));
+            op.second = courses.id(courses.next(rng));
+            if (op.kind == ENROLL && pending.size() < PENDING) {
+                pending.emplace_back(op.first, op.second);
+            } else if (op.kind == ENROLL) {
+                pending[rng() % PENDING] = std::make_pair(op.first, op.second);
+            }
+        } else if (op.kind == AWARD) {
+            op.first = 1 + int(rng() % 10);
+        } else {
+            op.first = students.id(students.next(rng));
+        }
+    }
+    return ops;
+}
+
+void preload(TechSystem& system, const IdSpace& students, const IdSpace& courses,
+             const int enrolled) {
+    for (int c = 0; c < courses.size(); ++c) {
+        system.addCourse(courses.id(c), 1 + c % 100);
+    }
+    for (int s = 0; s < students.size(); s += 2) {
+        system.addStudent(students.id(s));
+        for (int e = 0; e < enrolled && e < courses.size(); ++e) {
+            system.enrollStudent(students.id(s), courses.id((s + e * 7919) % courses.size()));
+        }
+    }
+}
+
+bool apply(TechSystem& system, const Op& op) {
+    switch (op.kind) {
+        case ADD:
+            return system.addStudent(op.first) == StatusType::SUCCESS;
+        case REMOVE:
+            return system.removeStudent(op.first) == StatusType::SUCCESS;
+        case ENROLL:
+            return system.enrollStudent(op.first, op.second) == StatusType::SUCCESS;
+        case COMPLETE:
+            return system.completeCourse(op.first, op.second) == StatusType::SUCCESS;
+        case GET:
+            return system.getStudentPoints(op.first).status() == StatusType::SUCCESS;
+        default:
+            return system.awardAcademicPoints(op.first) == StatusType::SUCCESS;
+    }
+}
+
+/**
+ * @brief The timed calls of one operation and what they add up to.
+ */
+struct Samples {
+    std::vector<unsigned> ns;
+    long long succeeded = 0;
+
+    void add(const Clock::time_point start, const bool success) {
+        ns.push_back(elapsedNs(start, Clock::now()));
+        succeeded += success;
+    }
+};
+
+struct Result {
+    std::string name;
+    long long count;
+    long long succeeded;
+    double throughput; // operations per second.
+    double meanNs;
+    double p50Ns;
+    double p99Ns;
+    double p999Ns;
+    double maxNs;
+};
+
+// Nearest-rank percentiles of the samples, which get sorted.
+Result summarize(const std::string& name, Samples& samples, double throughput) {
+    std::vector<unsigned>& ns = samples.ns;
+    std::sort(ns.begin(), ns.end());
+    Result result = {name, (long long)ns.size(), samples.succeeded, throughput, 0, 0, 0, 0, 0};
+    if (ns.empty()) {
+        return result;
+    }
+    const auto at = [&](const double fraction) {
+        return double(ns[std::min(ns.size() - 1, size_t(fraction * ns.size()))]);
+    };
+    double total = 0;
+    for (unsigned sample : ns) {
+        total += sample;
+    }
+    result.meanNs = total / ns.size();
+    result.p50Ns = at(0.5);
+    result.p99Ns = at(0.99);
+    result.p999Ns = at(0.999);
+    result.maxNs = ns.back();
+    if (result.throughput == 0) {
+        result.throughput = 1e9 / result.meanNs;
+    }
+    return result;
+}
+
+struct Config {
+    int ops = 1000000;
+    int students = 100000;
+    int courses = 1000;
+    int enrolled = 2;
+    double zipf = 0.99;
+    unsigned long long seed = 1;
+    std::string mix = "balanced";
+    std::string dist = "all";
+    std::string json;
+    std::string baseline;
+    double tolerance = 10;
+};
+
+// What the trees of each role did during the timed replay, with
+// ENABLE_TREE_STATS. The heights are the largest seen since the start.
+void printTreeCounters(const TreeCounters before[3], const TreeCounters after[3]) {
+    static const char* const roles[3] = {"student index", "rosters", "enrollments"};
+    std::printf("  %-14s %11s %8s %10s %10s %10s %10s %7s\n", "tree role", "lookups",
+                "cmp/look", "single rot", "double rot", "allocated", "freed", "height");
+    for (int i = 0; i < 3; ++i) {
+        const long long lookups = after[i].lookups - before[i].lookups;
+        const long long comparisons = after[i].comparisons - before[i].comparisons;
+        std::printf("  %-14s %11lld %8.2f %10lld %10lld %10lld %10lld %7d\n", roles[i], lookups,
+                    lookups > 0 ? double(comparisons) / double(lookups) : 0.0,
+                    after[i].singleRotations - before[i].singleRotations,
+                    after[i].doubleRotations - before[i].doubleRotations,
+                    after[i].allocated - before[i].allocated, after[i].freed - before[i].freed,
+                    after[i].maxHeight);
+    }
+}
+
+void runSystem(const Config& config, const Dist dist, std::vector<Result>& results) {
+    int weights[OP_KINDS];
+    parseMix(config.mix, weights);
+    std::mt19937_64 rng(config.seed);
+    IdSpace students(dist, config.students, config.zipf, rng);
+    IdSpace courses(dist, config.courses, config.zipf, rng);
+    const std::vector<Op> ops = generate(config.ops, weights, students, courses, rng);
+    const std::string prefix = std::string("tech.") + DIST_NAMES[int(dist)] + "." + config.mix + ".";
+
+    long long succeeded = 0;
+    double throughput;
+    {
+        TechSystem system;
+        preload(system, students, courses, config.enrolled);
+        const Clock::time_point start = Clock::now();
+        for (const Op& op : ops) {
+            succeeded += apply(system, op);
+        }
+        throughput = ops.size() * 1e9 / elapsedNs(start, Clock::now());
+    }
+
+    Samples samples[OP_KINDS];
+    Samples all;
+    for (int kind = 0; kind < OP_KINDS; ++kind) {
+        samples[kind].ns.reserve(size_t(ops.size() * weights[kind] /
+                                        std::accumulate(weights, weights + OP_KINDS, 0.0) * 1.1));
+    }
+    TreeCounters before[3];
+    TreeCounters after[3];
+    {
+        TechSystem system;
+        preload(system, students, courses, config.enrolled);
+        const bool counted = system.getTreeStats(&before[0], &before[1], &before[2]) ==
+                             StatusType::SUCCESS;
+        for (const Op& op : ops) {
+            const Clock::time_point start = Clock::now();
+            samples[op.kind].add(start, apply(system, op));
+        }
+        if (counted) {
+            system.getTreeStats(&after[0], &after[1], &after[2]);
+            printTreeCounters(before, after);
+        }
+    }
+    for (int kind = 0; kind < OP_KINDS; ++kind) {
+        all.ns.insert(all.ns.end(), samples[kind].ns.begin(), samples[kind].ns.end());
+        all.succeeded += samples[kind].succeeded;
+    }
+    results.push_back(summarize(prefix + "all", all, throughput));
+    results.back().succeeded = succeeded;
+    for (int kind = 0; kind < OP_KINDS; ++kind) {
+        if (!samples[kind].ns.empty()) {
+            results.push_back(summarize(prefix + OP_NAMES[kind], samples[kind], 0));
+        }
+    }
+}
+
+enum TreeOp { INSERT, FIND, RANK, SELECT, ERASE, TREE_OPS };
+
+const char* const TREE_OP_NAMES[TREE_OPS] = {"insert", "find", "rank", "select", "remove"};
+
+/**
+ * @brief Run every Tree phase once. Timed runs fill samples, untimed runs
+ * add the duration of each phase to phaseNs.
+ */
+template <bool Timed>
+void runTreePhases(std::vector<Record>& records, const std::vector<int>& order,
+                   const std::vector<int>& lookups, Samples samples[TREE_OPS],
+                   double phaseNs[TREE_OPS]) {
+    typedef Tree<Record*, PoolAllocator, true> Index;
+    Index index;
+    const int size = int(records.size());
+    const size_t rankCount = lookups.size() / 4;
+    long long checksum = 0;
+    Clock::time_point phase = Clock::now();
+    const auto endPhase = [&](const TreeOp op) {
+        const Clock::time_point now = Clock::now();
+        phaseNs[op] += elapsedNs(phase, now);
+        phase = now;
+    };
+
+    for (int at : order) {
+        const Clock::time_point start = Timed ? Clock::now() : phase;
+        const bool success = index.tryInsert(&records[at]) == TreeResult::SUCCESS;
+        if (Timed) {
+            samples[INSERT].add(start, success);
+        }
+    }
+    endPhase(INSERT);
+    for (int at : lookups) {
+        const Clock::time_point start = Timed ? Clock::now() : phase;
+        Record** found = index.tryFind(records[at].id);
+        checksum += found != nullptr;
+        if (Timed) {
+            samples[FIND].add(start, found != nullptr);
+        }
+    }
+    endPhase(FIND);
+    for (size_t i = 0; i < rankCount; ++i) {
+        const Clock::time_point start = Timed ? Clock::now() : phase;
+        const int rank = index.rank(records[lookups[i]].id);
+        checksum += rank;
+        if (Timed) {
+            samples[RANK].add(start, rank < size);
+        }
+    }
+    endPhase(RANK);
+    for (size_t i = 0; i < rankCount; ++i) {
+        const Clock::time_point start = Timed ? Clock::now() : phase;
+        Record** found = index.select(lookups[lookups.size() - 1 - i]);
+        checksum += found != nullptr;
+        if (Timed) {
+            samples[SELECT].add(start, found != nullptr);
+        }
+    }
+    endPhase(SELECT);
+    for (int at : order) {
+        const Clock::time_point start = Timed ? Clock::now() : phase;
+        const bool success = index.tryRemove(records[at].id) == TreeResult::SUCCESS;
+        if (Timed) {
+            samples[ERASE].add(start, success);
+        }
+    }
+    endPhase(ERASE);
+    if (checksum < 0) {
+        std::printf("unreachable\n");
+    }
+}
+
+void runTree(const Config& config, const Dist dist, std::vector<Result>& results) {
+    std::mt19937_64 rng(config.seed);
+    IdSpace space(dist, config.students, config.zipf, rng);
+    std::vector<Record> records(space.size());
+    for (int i = 0; i < space.size(); ++i) {
+        records[i].id = space.id(i);
+    }
+    const std::vector<int> order = space.order(rng);
+    std::vector<int> lookups(config.ops);
+    for (int& at : lookups) {
+        at = space.next(rng);
+    }
+
+    Samples untimed[TREE_OPS];
+    double phaseNs[TREE_OPS] = {};
+    runTreePhases<false>(records, order, lookups, untimed, phaseNs);
+    Samples samples[TREE_OPS];
+    double unused[TREE_OPS] = {};
+    runTreePhases<true>(records, order, lookups, samples, unused);
+
+    const std::string prefix = std::string("tree.") + DIST_NAMES[int(dist)] + ".";
+    for (int op = 0; op < TREE_OPS; ++op) {
+        const double count = double(samples[op].ns.size());
+        results.push_back(summarize(prefix + TREE_OP_NAMES[op], samples[op],
+                                    phaseNs[op] > 0 ? count * 1e9 / phaseNs[op] : 0));
+    }
+}
+
+void printResults(const std::vector<Result>& results, const size_t from) {
+    std::printf("  %-44s %9s %9s %12s %8s %8s %8s %8s %9s\n", "operation", "count", "ok",
+                "ops/s", "mean", "p50", "p99", "p999", "max");
+    for (size_t i = from; i < results.size(); ++i) {
+        const Result& r = results[i];
+        std::printf("  %-44s %9lld %9lld %12.0f %8.0f %8.0f %8.0f %8.0f %9.0f\n",
+                    r.name.c_str(), r.count, r.succeeded, r.throughput, r.meanNs, r.p50Ns,
+                    r.p99Ns, r.p999Ns, r.maxNs);
+    }
+}
+
+bool writeJson(const Config& config, const double overheadNs,
+               const std::vector<Result>& results) {
+    FILE* out = std::fopen(config.json.c_str(), "w");
+    if (out == nullptr) {
+        return false;
+    }
+    std::fprintf(out,
+                 "{\"config\":{\"ops\":%d,\"students\":%d,\"courses\":%d,\"enrolled\":%d,"
+                 "\"zipf\":%g,\"seed\":%llu,\"mix\":\"%s\",\"timer_overhead_ns\":%.0f},\n"
+                 "\"results\":[\n",
+                 config.ops, config.students, config.courses, config.enrolled, config.zipf,
+                 config.seed, config.mix.c_str(), overheadNs);
+    for (size_t i = 0; i < results.size(); ++i) {
+        const Result& r = results[i];
+        std::fprintf(out,
+                     "{\"name\":\"%s\",\"count\":%lld,\"ok\":%lld,\"throughput_ops\":%.1f,"
+                     "\"mean_ns\":%.1f,\"p50_ns\":%.0f,\"p99_ns\":%.0f,\"p999_ns\":%.0f,"
+                     "\"max_ns\":%.0f}%s\n",
+                     r.name.c_str(), r.count, r.succeeded, r.throughput, r.meanNs, r.p50Ns,
+                     r.p99Ns, r.p999Ns, r.maxNs, i + 1 < results.size() ? "," : "");
+    }
+    std::fprintf(out, "]}\n");
+    return std::fclose(out) == 0;
+}
+
+// Compares with the results of an earlier json= file by name, returns the
+// number of regressions, or -1 if the baseline cannot be read.
+int compareBaseline(const Config& config, const std::vector<Result>& results) {
+    FILE* in = std::fopen(config.baseline.c_str(), "r");
+    if (in == nullptr) {
+        return -1;
+    }
+    const double slack = config.tolerance / 100;
+    int regressions = 0;
+    char line[1024];
+    std::printf("baseline %s, tolerance %g%%\n", config.baseline.c_str(), config.tolerance);
+    std::printf("  %-44s %10s %10s\n", "operation", "p50", "ops/s");
+    while (std::fgets(line, sizeof(line), in) != nullptr) {
+        const char* name = std::strstr(line, "\"name\":\"");
+        const char* p50 = std::strstr(line, "\"p50_ns\":");
+        const char* throughput = std::strstr(line, "\"throughput_ops\":");
+        if (name == nullptr || p50 == nullptr || throughput == nullptr) {
+            continue;
+        }
+        name += std::strlen("\"name\":\"");
+        const std::string key(name, std::strchr(name, '"') - name);
+        const double baseP50 = std::atof(p50 + std::strlen("\"p50_ns\":"));
+        const double baseThroughput = std::atof(throughput + std::strlen("\"throughput_ops\":"));
+        for (const Result& r : results) {
+            if (r.name != key || baseP50 <= 0 || baseThroughput <= 0) {
+                continue;
+            }
+            const bool slower = r.p50Ns > baseP50 * (1 + slack);
+            const bool lower = r.throughput < baseThroughput * (1 - slack);
+            std::printf("  %-44s %+9.1f%% %+9.1f%%%s\n", key.c_str(),
+                        (r.p50Ns / baseP50 - 1) * 100, (r.throughput / baseThroughput - 1) * 100,
+                        slower || lower ? "  REGRESSION" : "");
+            regressions += slower || lower;
+        }
+    }
+    std::fclose(in);
+    return regressions;
+}
+
+bool parseArgument(const std::string& argument, Config& config) {
+    const size_t equals = argument.find('=');
+    if (equals == std::string::npos) {
+        return false;
+    }
+    const std::string name = argument.substr(0, equals);
+    const std::string value = argument.substr(equals + 1);
+    if (name == "ops") {
+        config.ops = std::atoi(value.c_str());
+    } else if (name == "students") {
+        config.students = std::atoi(value.c_str());
+    } else if (name == "courses") {
+        config.courses = std::atoi(value.c_str());
+    } else if (name == "enrolled") {
+        config.enrolled = std::atoi(value.c_str());
+    } else if (name == "zipf") {
+        config.zipf = std::atof(value.c_str());
+    } else if (name == "seed") {
+        config.seed = std::strtoull(value.c_str(), nullptr, 10);
+    } else if (name == "mix") {
+        config.mix = value;
+    } else if (name == "dist") {
+        config.dist = value;
+    } else if (name == "json") {
+        config.json = value;
+    } else if (name == "baseline") {
+        config.baseline = value;
+    } else if (name == "tolerance") {
+        config.tolerance = std::atof(value.c_str());
+    } else {
+        return false;
+    }
+    return true;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    Config config;
+    for (int i = 1; i < argc; ++i) {
+        if (!parseArgument(argv[i], config)) {
+            std::fprintf(stderr, "unknown argument %s, see the comment at the top of "
+                                 "bench/workload_bench.cpp\n", argv[i]);
+            return 2;
+        }
+    }
+    int weights[OP_KINDS];
+    const bool knownDist = config.dist == "all" ||
+        std::find(DIST_NAMES, DIST_NAMES + 4, config.dist) != DIST_NAMES + 4;
+    if (config.ops <= 0 || config.ops > 10000000 || config.students < 2 ||
+        config.courses < 1 || config.enrolled < 0 || config.zipf <= 0 || !knownDist ||
+        !parseMix(config.mix, weights)) {
+        std::fprintf(stderr, "invalid configuration\n");
+        return 2;
+    }
+
+    const double overheadNs = timerOverheadNs();
+    std::printf("ops %d, students %d, courses %d, enrolled %d, mix %s, seed %llu, "
+                "timer overhead %.0f ns\n", config.ops, config.students, config.courses,
+                config.enrolled, config.mix.c_str(), config.seed, overheadNs);
+    std::vector<Result> results;
+    for (int d = 0; d < 4; ++d) {
+        if (config.dist != "all" && config.dist != DIST_NAMES[d]) {
+            continue;
+        }
+        const Dist dist = Dist(d);
+        std::printf("%s\n", DIST_NAMES[d]);
+        const size_t from = results.size();
+        runSystem(config, dist, results);
+        runTree(config, dist, results);
+        printResults(results, from);
+    }
+
+    if (!config.json.empty() && !writeJson(config, overheadNs, results)) {
+        std::fprintf(stderr, "cannot write %s\n", config.json.c_str());
+        return 1;
+    }
+    if (!config.baseline.empty()) {
+        const int regressions = compareBaseline(config, results);
+        if (regressions < 0) {
+            std::fprintf(stderr, "cannot read %s\n", config.baseline.c_str());
+            return 1;
+        }
+        return regressions == 0 ? 0 : 1;
+    }
+    return 0;
+}
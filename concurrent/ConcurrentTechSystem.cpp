@@ -0,0 +1,241 @@
+#include "ConcurrentTechSystem.h"
+
+namespace {
+
+// Holds the locks of two shards, taken in address order. The shards live
+// in one array, so this is a single global order and no cycle of waiting
+// threads can form.
+class PairLock {
+public:
+    PairLock(std::mutex& first, std::mutex& second)
+        : low(&first < &second ? first : second),
+          high(&first < &second ? second : first) {
+        low.lock();
+        if (&high != &low) {
+            high.lock();
+        }
+    }
+
+    PairLock(const PairLock&) = delete;
+    PairLock& operator=(const PairLock&) = delete;
+
+    ~PairLock() {
+        if (&high != &low) {
+            high.unlock();
+        }
+        low.unlock();
+    }
+
+private:
+    std::mutex& low;
+    std::mutex& high;
+};
+
+} // namespace
+
+ConcurrentTechSystem::ConcurrentTechSystem(const int shardCount)
+    : shardCount(shardCount > 0 ? shardCount : 1),
+      shards(new Shard[shardCount > 0 ? shardCount : 1]),
+      bonusPoints(0) {}
+
+ConcurrentTechSystem::~ConcurrentTechSystem()
+{
+    for (int i = 0; i < shardCount; ++i) {
+        shards[i].courses.clear([](Course* course) {
+            delete course;
+        });
+        shards[i].students.clear([](Student* student) {
+            delete student;
+        });
+    }
+}
+
+StatusType ConcurrentTechSystem::addStudent(const int studentId)
+{
+    if (studentId <= 0) {return StatusType::INVALID_INPUT;}
+    Shard& shard = shardOf(studentId);
+    std::lock_guard<std::mutex> guard(shard.lock);
+    Student* student = nullptr;
+    try {
+        // The bonus is read under the lock, so no reader of this shard can
+        // see the student with a bonus older than its creation.
+        student = new Student(studentId, -bonusPoints.load());
+        if (shard.students.tryInsert(student) != TreeResult::SUCCESS) {
+            delete student;
+            return StatusType::FAILURE;
+        }
+        try {
+            shard.snapshot.assign(studentId, student->points);
+        } catch (std::bad_alloc&) {
+            shard.students.tryRemove(studentId);
+            throw;
+        }
+        return StatusType::SUCCESS;
+    } catch (std::bad_alloc&) {
+        delete student;
+        return StatusType::ALLOCATION_ERROR;
+    }
+}
+
+StatusType ConcurrentTechSystem::removeStudent(const int studentId)
+{
+    if (studentId <= 0) {return StatusType::INVALID_INPUT;}
+    Shard& shard = shardOf(studentId);
+    std::lock_guard<std::mutex> guard(shard.lock);
+    Student* const* studentPtr = shard.students.tryFind(studentId);
+    if (studentPtr == nullptr || (*studentPtr)->numOfCourses > 0) {
+        return StatusType::FAILURE;
+    }
+    try {
+        shard.snapshot.remove(studentId);
+    } catch (std::bad_alloc&) {
+        return StatusType::ALLOCATION_ERROR;
+    }
+    Student* student = *studentPtr;
+    shard.students.tryRemove(studentId);
+    delete student;
+    return StatusType::SUCCESS;
+}
+
+StatusType ConcurrentTechSystem::addCourse(const int courseId, const int points)
+{
+    if (courseId <= 0 || points <= 0) {return StatusType::INVALID_INPUT;}
+    Shard& shard = shardOf(courseId);
+    std::lock_guard<std::mutex> guard(shard.lock);
+    Course* course = nullptr;
+    try {
+        course = new Course(courseId, points);
+        if (shard.courses.tryInsert(course) != TreeResult::SUCCESS) {
+            delete course;
+            return StatusType::FAILURE;
+        }
+        return StatusType::SUCCESS;
+    } catch (std::bad_alloc&) {
+        delete course;
+        return StatusType::ALLOCATION_ERROR;
+    }
+}
+
+StatusType ConcurrentTechSystem::removeCourse(const int courseId)
+{
+    if (courseId <= 0) {return StatusType::INVALID_INPUT;}
+    Shard& shard = shardOf(courseId);
+    std::lock_guard<std::mutex> guard(shard.lock);
+    Course* const* coursePtr = shard.courses.tryFind(courseId);
+    if (coursePtr == nullptr || !(*coursePtr)->students.isEmpty()) {
+        return StatusType::FAILURE;
+    }
+    Course* course = *coursePtr;
+    shard.courses.tryRemove(courseId);
+    delete course;
+    return StatusType::SUCCESS;
+}
+
+StatusType ConcurrentTechSystem::enrollStudent(const int studentId, const int courseId)
+{
+    if (studentId <= 0 || courseId <= 0) {return StatusType::INVALID_INPUT;}
+    Shard& studentShard = shardOf(studentId);
+    Shard& courseShard = shardOf(courseId);
+    PairLock guard(studentShard.lock, courseShard.lock);
+    Course* const* coursePtr = courseShard.courses.tryFind(courseId);
+    if (coursePtr == nullptr) {
+        return StatusType::FAILURE;
+    }
+    Student* const* studentPtr = studentShard.students.tryFind(studentId);
+    if (studentPtr == nullptr) {
+        return StatusType::FAILURE;
+    }
+    try {
+        if ((*coursePtr)->students.tryInsert(*studentPtr) != TreeResult::SUCCESS) {
+            return StatusType::FAILURE;
+        }
+    } catch (std::bad_alloc&) {
+        return StatusType::ALLOCATION_ERROR;
+    }
+    (*studentPtr)->numOfCourses++;
+    return StatusType::SUCCESS;
+}
+
+StatusType ConcurrentTechSystem::completeCourse(const int studentId, const int courseId)
+{
+    if (studentId <= 0 || courseId <= 0) {return StatusType::INVALID_INPUT;}
+    Shard& studentShard = shardOf(studentId);
+    Shard& courseShard = shardOf(courseId);
+    PairLock guard(studentShard.lock, courseShard.lock);
+    Course* const* coursePtr = courseShard.courses.tryFind(courseId);
+    if (coursePtr == nullptr) {
+        return StatusType::FAILURE;
+    }
+    Course* course = *coursePtr;
+    Student* const* studentPtr = course->students.tryFind(studentId);
+    if (studentPtr == nullptr) {
+        return StatusType::FAILURE;
+    }
+    Student* student = *studentPtr;
+    try {
+        studentShard.snapshot.assign(studentId, student->points + course->points);
+    } catch (std::bad_alloc&) {
+        return StatusType::ALLOCATION_ERROR;
+    }
+    student->points += course->points;
+    student->numOfCourses--;
+    course->students.tryRemove(studentId);
+    return StatusType::SUCCESS;
+}
+
+StatusType ConcurrentTechSystem::awardAcademicPoints(const int points)
+{
+    if (points <= 0) {return StatusType::INVALID_INPUT;}
+    // The bonus is published in every snapshot rather than read from
+    // bonusPoints by getStudentPoints. A lock-free read loads a snapshot
+    // and would then load the bonus later. A completeCourse and an award
+    // can both land between those two loads. The read would then return
+    // the points from before the completion plus the new bonus, a state
+    // that never existed. The price is this O(shards) pass, during which
+    // every writer waits. Awards are rare next to the per-student calls,
+    // and each shard costs one lock and one version swap, with no trie
+    // copying, so the pass stays short.
+    //
+    // All shards are locked, so no writer can see a shard with the old bonus
+    // after another one has the new one. Allocate first, so that either
+    // every snapshot gets the bonus or none does.
+    for (int i = 0; i < shardCount; ++i) {
+        shards[i].lock.lock();
+    }
+    StatusType status = StatusType::SUCCESS;
+    try {
+        for (int i = 0; i < shardCount; ++i) {
+            shards[i].snapshot.prepare();
+        }
+        const int bonus = bonusPoints.fetch_add(points) + points;
+        for (int i = 0; i < shardCount; ++i) {
+            shards[i].snapshot.setBonus(bonus);
+        }
+    } catch (std::bad_alloc&) {
+        status = StatusType::ALLOCATION_ERROR;
+    }
+    for (int i = shardCount - 1; i >= 0; --i) {
+        shards[i].lock.unlock();
+    }
+    return status;
+}
+
+output_t<int> ConcurrentTechSystem::getStudentPoints(const int studentId)
+{
+    if (studentId <= 0) {return StatusType::INVALID_INPUT;}
+    Shard& shard = shardOf(studentId);
+    int points = 0;
+    bool found;
+    EpochDomain::Guard pin(EpochDomain::global());
+    if (pin.pinned()) {
+        found = shard.snapshot.read(studentId, points);
+    } else {
+        // More threads than reader slots, the lock keeps the snapshot alive.
+        std::lock_guard<std::mutex> guard(shard.lock);
+        found = shard.snapshot.read(studentId, points);
+    }
+    if (!found) {
+        return StatusType::FAILURE;
+    }
+    return points;
+}
@@ -0,0 +1,120 @@
+#ifndef CONCURRENTTECHSYSTEM_H
+#define CONCURRENTTECHSYSTEM_H
+
+#include "wet1util.h"
+#include "Tree.h"
+#include "HashIndex.h"
+#include "PointsSnapshot.h"
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+
+/**
+ * @brief A TechSystem that many threads may call at once.
+ *
+ * Students and courses are spread over shards by id, and every shard has
+ * its own lock, so calls on different shards run in parallel. A call that
+ * needs a student and a course locks both shards, the lower index first,
+ * so no two calls can wait on each other. The bonus of
+ * awardAcademicPoints is an atomic per system rather than a global.
+ *
+ * getStudentPoints takes no lock: every shard also publishes its students'
+ * points and the bonus as an immutable PointsSnapshot, which writers
+ * replace in O(log n) and readers look up without ever blocking them.
+ * awardAcademicPoints locks every shard to publish the new bonus in all
+ * snapshots, in O(shards).
+ *
+ * Each writing call behaves as if it ran alone at some instant between its
+ * start and its return, with the results of the same call on TechSystem.
+ * A read sees one published version of its student's shard: the points and
+ * the bonus always belong together, but while an award is being published,
+ * reads on different shards may briefly disagree on whether it happened.
+ *
+ * Records and tree nodes come from the heap: the pools of TechSystem are
+ * not thread-safe.
+ */
+class ConcurrentTechSystem {
+private:
+    class Student {
+    public:
+        int id;
+        // Points minus the bonus at the time the student was added.
+        int points;
+        int numOfCourses;
+
+        Student(const int id, const int points) : id(id), points(points), numOfCourses(0) {}
+
+        bool operator<(const Student& other) const {
+            return this->id < other.id;
+        }
+        bool operator>(const Student& other) const {
+            return this->id > other.id;
+        }
+        bool operator>(const int other) const {
+            return this->id > other;
+        }
+        bool operator==(const int other) const {
+            return this->id == other;
+        }
+        explicit operator int() const { return id; }
+    };
+
+    class Course {
+    public:
+        int id;
+        int points;
+        // Non-owning handles, the records belong to the students' shards.
+        Tree<Student*> students;
+
+        Course(const int id, const int points) : id(id), points(points) {}
+
+        explicit operator int() const { return id; }
+    };
+
+    // Padded to a cache line, so that locking one shard does not slow
+    // down threads working on its neighbours.
+    struct alignas(64) Shard {
+        std::mutex lock;
+        HashIndex<Student*> students;
+        HashIndex<Course*> courses;
+        // Lock-free copy of the students' points, for getStudentPoints.
+        PointsSnapshot snapshot;
+    };
+
+    const int shardCount;
+    std::unique_ptr<Shard[]> shards;
+    std::atomic<int> bonusPoints;
+
+    Shard& shardOf(const int id) const {
+        return shards[unsigned(id) % unsigned(shardCount)];
+    }
+
+public:
+    // Constructor. More shards than threads keeps collisions rare.
+    explicit ConcurrentTechSystem(int shardCount = 64);
+
+    ConcurrentTechSystem(const ConcurrentTechSystem&) = delete;
+    ConcurrentTechSystem& operator=(const ConcurrentTechSystem&) = delete;
+
+    // Destructor. No call may be running.
+    ~ConcurrentTechSystem();
+
+    StatusType addStudent(int studentId);
+
+    StatusType removeStudent(int studentId);
+
+    StatusType addCourse(int courseId, int points);
+
+    StatusType removeCourse(int courseId);
+
+    StatusType enrollStudent(int studentId, int courseId);
+
+    StatusType completeCourse(int studentId, int courseId);
+
+    StatusType awardAcademicPoints(int points);
+
+    output_t<int> getStudentPoints(int studentId);
+};
+
+#endif //CONCURRENTTECHSYSTEM_H
@@ -0,0 +1,142 @@
+#ifndef EPOCHDOMAIN_H
+#define EPOCHDOMAIN_H
+
+#include <atomic>
+#include <climits>
+
+/**
+ * @brief Epoch-based reclamation for objects that lock-free readers may
+ * still be looking at.
+ *
+ * A reader pins itself with a Guard before loading a shared pointer and
+ * unpins when the guard goes away. A writer that unlinks objects calls
+ * retireEpoch() once after unlinking, tags the objects with the returned
+ * epoch, and may free them once safeEpoch() is greater than the tag: every
+ * reader pinned at that point started after the unlink, so none of them
+ * can reach the objects.
+ *
+ * Readers only write to their own cache line and never wait. Each thread
+ * takes one of MAX_READERS slots on its first read and gives it back when
+ * it exits. Threads beyond that have no slot, Guard::pinned() tells them
+ * to fall back to a locked read.
+ */
+class EpochDomain {
+private:
+    struct alignas(64) Slot {
+        std::atomic<unsigned long long> announced; // 0 while not reading.
+        std::atomic<bool> taken;
+    };
+
+public:
+    static const int MAX_READERS = 128;
+
+    /**
+     * @brief Pins the calling thread for the guard's lifetime.
+     */
+    class Guard {
+    public:
+        explicit Guard(EpochDomain& domain) : slot(domain.slotOfThisThread()) {
+            if (slot == nullptr) {
+                return;
+            }
+            // Announce, then check the epoch did not move in between. A
+            // writer that scanned before the announcement bumped the epoch
+            // first, so the check fails and the reader announces again.
+            unsigned long long epoch = domain.epoch.load();
+            while (true) {
+                slot->announced.store(epoch);
+                const unsigned long long now = domain.epoch.load();
+                if (now == epoch) {
+                    break;
+                }
+                epoch = now;
+            }
+        }
+
+        Guard(const Guard&) = delete;
+        Guard& operator=(const Guard&) = delete;
+
+        ~Guard() {
+            if (slot != nullptr) {
+                slot->announced.store(0, std::memory_order_release);
+            }
+        }
+
+        bool pinned() const {
+            return slot != nullptr;
+        }
+
+    private:
+        Slot* slot;
+    };
+
+    // The domain shared by every structure in the process, so that a
+    // thread needs a single slot.
+    static EpochDomain& global() {
+        static EpochDomain domain;
+        return domain;
+    }
+
+    /**
+     * @brief Start a new epoch, call after unlinking objects.
+     *
+     * @return The tag for the objects just unlinked.
+     */
+    unsigned long long retireEpoch() {
+        return epoch.fetch_add(1);
+    }
+
+    /**
+     * @brief Objects tagged with a smaller epoch may be freed.
+     */
+    unsigned long long safeEpoch() const {
+        unsigned long long safe = ULLONG_MAX;
+        for (int i = 0; i < MAX_READERS; ++i) {
+            const unsigned long long announced = slots[i].announced.load();
+            if (announced != 0 && announced < safe) {
+                safe = announced;
+            }
+        }
+        return safe;
+    }
+
+private:
+    // Gives the slot back when its thread exits.
+    struct Registration {
+        bool registered = false;
+        Slot* slot = nullptr;
+
+        ~Registration() {
+            if (slot != nullptr) {
+                slot->taken.store(false, std::memory_order_release);
+            }
+        }
+    };
+
+    std::atomic<unsigned long long> epoch;
+    Slot slots[MAX_READERS];
+
+    EpochDomain() : epoch(1) {
+        for (int i = 0; i < MAX_READERS; ++i) {
+            slots[i].announced.store(0);
+            slots[i].taken.store(false);
+        }
+    }
+
+    Slot* slotOfThisThread() {
+        static thread_local Registration registration;
+        if (!registration.registered) {
+            registration.registered = true;
+            for (int i = 0; i < MAX_READERS; ++i) {
+                bool expected = false;
+                if (slots[i].taken.compare_exchange_strong(expected, true)) {
+                    registration.slot = &slots[i];
+                    break;
+                }
+            }
+        }
+        return registration.slot;
+    }
+};
+
+#endif //EPOCHDOMAIN_H
@@ -0,0 +1,356 @@
+#ifndef POINTSSNAPSHOT_H
+#define POINTSSNAPSHOT_H
+
+#include "EpochDomain.h"
+#include "Pool.h"
+
+#include <atomic>
+#include <cstddef>
+#include <new>
+#include <vector>
+
+/**
+ * @brief Student points that readers can look up without taking a lock.
+ *
+ * The points live in a persistent hash trie: a node has 32 slots picked by
+ * five bits of the hashed id, and a slot holds one student or a child node
+ * for the ids that share those bits. A write never changes a node that was
+ * published, it copies the few nodes on the path to the change and
+ * publishes a new version, a root and the bonus offset, through one atomic
+ * pointer. A reader loads the version once and sees a consistent state of
+ * every student and the bonus, no matter what the writers do in the
+ * meantime, after about log32(n) node visits.
+ *
+ * Replaced nodes and versions go back to the snapshot's pools through
+ * EpochDomain once no pinned reader can still reach them. The pools are
+ * only touched by writers, so they need no locking of their own.
+ *
+ * Writers must be serialized by the caller. Readers must either be pinned
+ * with an EpochDomain::Guard or hold the lock that serializes the writers.
+ * Ids must be positive.
+ */
+class PointsSnapshot {
+private:
+    static const int BITS = 5;
+    static const int WIDTH = 1 << BITS;
+
+    struct Node;
+
+    // Empty if key is 0, a child node if child is set, a student otherwise.
+    struct Slot {
+        int key;
+        int value;
+        const Node* child;
+    };
+
+    struct Node {
+        Slot slots[WIDTH];
+    };
+
+    struct Version {
+        const Node* root;
+        int bonus;
+    };
+
+    // A node or a version no longer reachable from the current version.
+    struct Retired {
+        const Node* node;
+        const Version* version;
+        unsigned long long epoch;
+    };
+
+    // Free retired objects once this many have piled up.
+    static const int RECLAIM_BATCH = 64;
+
+    ObjectPool<Node> nodes;
+    ObjectPool<Version> versions;
+    std::atomic<const Version*> current;
+    // Set by prepare(), so that the next publish cannot fail.
+    Version* spare;
+    // Nodes created and replaced by the write in progress.
+    std::vector<Node*> fresh;
+    std::vector<const Node*> replaced;
+    std::vector<Retired> retired;
+
+    // A bijection, so two different ids always differ in some level.
+    static unsigned hash(const int key) {
+        return unsigned(key) * 2654435769u;
+    }
+
+    static int indexAt(const unsigned hashed, const int depth) {
+        return int((hashed >> (depth * BITS)) & (WIDTH - 1));
+    }
+
+    static Slot emptySlot() {
+        Slot slot = {0, 0, nullptr};
+        return slot;
+    }
+
+    static Slot childSlot(const Node* node) {
+        Slot slot = {0, 0, node};
+        return slot;
+    }
+
+    static bool isEmpty(const Slot& slot) {
+        return slot.key == 0 && slot.child == nullptr;
+    }
+
+    // A copy of node, or an empty node if node is null.
+    // @throws std::bad_alloc
+    Node* copy(const Node* node) {
+        fresh.push_back(nullptr);
+        Node* created = nodes.create();
+        fresh.back() = created;
+        if (node == nullptr) {
+            for (int i = 0; i < WIDTH; ++i) {
+                created->slots[i] = emptySlot();
+            }
+            return created;
+        }
+        *created = *node;
+        replaced.push_back(node);
+        return created;
+    }
+
+    // A node holding two students whose hashes agree below depth.
+    // @throws std::bad_alloc
+    const Node* split(const Slot& first, const Slot& second, const int depth) {
+        Node* node = copy(nullptr);
+        const int firstIndex = indexAt(hash(first.key), depth);
+        const int secondIndex = indexAt(hash(second.key), depth);
+        if (firstIndex == secondIndex) {
+            node->slots[firstIndex] = childSlot(split(first, second, depth + 1));
+        } else {
+            node->slots[firstIndex] = first;
+            node->slots[secondIndex] = second;
+        }
+        return node;
+    }
+
+    // @throws std::bad_alloc
+    const Node* assignAt(const Node* node, const unsigned hashed, const Slot& entry,
+                         const int depth) {
+        Node* updated = copy(node);
+        Slot& slot = updated->slots[indexAt(hashed, depth)];
+        if (slot.child != nullptr) {
+            slot.child = assignAt(slot.child, hashed, entry, depth + 1);
+        } else if (slot.key == 0 || slot.key == entry.key) {
+            slot = entry;
+        } else {
+            slot = childSlot(split(slot, entry, depth + 1));
+        }
+        return updated;
+    }
+
+    // The slot that takes the place of node once key is removed from it, or
+    // node itself if key is not there. A node left with a single student
+    // below the root is replaced by that student, so the trie stays as
+    // shallow as one built from scratch.
+    // @throws std::bad_alloc
+    Slot removeAt(const Node* node, const unsigned hashed, const int key, const int depth) {
+        const int index = indexAt(hashed, depth);
+        const Slot& slot = node->slots[index];
+        Slot replacement = emptySlot();
+        if (slot.child != nullptr) {
+            replacement = removeAt(slot.child, hashed, key, depth + 1);
+            if (replacement.child == slot.child) {
+                return childSlot(node);
+            }
+        } else if (slot.key != key) {
+            return childSlot(node);
+        }
+        if (depth > 0) {
+            int occupied = isEmpty(replacement) ? 0 : 1;
+            int last = index;
+            for (int i = 0; i < WIDTH && occupied < 2; ++i) {
+                if (i != index && !isEmpty(node->slots[i])) {
+                    occupied++;
+                    last = i;
+                }
+            }
+            const Slot& remaining = last == index ? replacement : node->slots[last];
+            if (occupied == 0 || (occupied == 1 && remaining.child == nullptr)) {
+                replaced.push_back(node);
+                return remaining;
+            }
+        }
+        Node* updated = copy(node);
+        updated->slots[index] = replacement;
+        return childSlot(updated);
+    }
+
+    // Drop the nodes of a write that failed, the published trie is intact.
+    void discard() {
+        for (Node* node : fresh) {
+            if (node != nullptr) {
+                nodes.destroy(node);
+            }
+        }
+        fresh.clear();
+        replaced.clear();
+    }
+
+    // Publish root with bonus as the new version. Cannot fail after prepare().
+    // @throws std::bad_alloc with nothing published.
+    void publish(const Node* root, const int bonus) {
+        try {
+            prepare();
+            reserveRetired(replaced.size() + 1);
+        } catch (std::bad_alloc&) {
+            discard();
+            throw;
+        }
+        const size_t firstRetired = retired.size();
+        for (const Node* node : replaced) {
+            retired.push_back({node, nullptr, 0});
+        }
+        fresh.clear();
+        replaced.clear();
+
+        Version* version = spare;
+        spare = nullptr;
+        version->root = root;
+        version->bonus = bonus;
+        retired.push_back({nullptr, current.exchange(version), 0});
+        const unsigned long long epoch = EpochDomain::global().retireEpoch();
+        for (size_t i = firstRetired; i < retired.size(); ++i) {
+            retired[i].epoch = epoch;
+        }
+        reclaim();
+    }
+
+    // Room for count more retired objects, growing geometrically.
+    // @throws std::bad_alloc
+    void reserveRetired(const size_t count) {
+        const size_t needed = retired.size() + count;
+        if (needed > retired.capacity()) {
+            retired.reserve(needed > 2 * retired.capacity() ? needed : 2 * retired.capacity());
+        }
+    }
+
+    void reclaim() {
+        if (retired.size() < size_t(RECLAIM_BATCH)) {
+            return;
+        }
+        const unsigned long long safe = EpochDomain::global().safeEpoch();
+        size_t kept = 0;
+        for (size_t i = 0; i < retired.size(); ++i) {
+            if (retired[i].epoch < safe) {
+                release(retired[i]);
+            } else {
+                retired[kept++] = retired[i];
+            }
+        }
+        retired.resize(kept);
+    }
+
+    void release(const Retired& item) {
+        if (item.node != nullptr) {
+            nodes.destroy(const_cast<Node*>(item.node));
+        } else {
+            versions.destroy(const_cast<Version*>(item.version));
+        }
+    }
+
+public:
+    // Constructor:
+    // @throws std::bad_alloc
+    PointsSnapshot() : current(nullptr), spare(nullptr) {
+        Version* version = versions.create();
+        version->root = copy(nullptr);
+        version->bonus = 0;
+        fresh.clear();
+        current.store(version);
+        retired.reserve(RECLAIM_BATCH * 2);
+    }
+
+    PointsSnapshot(const PointsSnapshot&) = delete;
+    PointsSnapshot& operator=(const PointsSnapshot&) = delete;
+
+    // Destructor. No reader or writer may be running. The pools release
+    // every node and version at once.
+    ~PointsSnapshot() = default;
+
+    /**
+     * @brief Look up a student, see the class comment for who may call.
+     *
+     * @param id The student id.
+     * @param points Set to the stored points plus the bonus, if found.
+     * @return true if the student is in the snapshot.
+     */
+    bool read(const int id, int& points) const {
+        const Version* version = current.load();
+        const unsigned hashed = hash(id);
+        const Node* node = version->root;
+        for (int depth = 0;; ++depth) {
+            const Slot& slot = node->slots[indexAt(hashed, depth)];
+            if (slot.child == nullptr) {
+                if (slot.key != id) {
+                    return false;
+                }
+                points = slot.value + version->bonus;
+                return true;
+            }
+            node = slot.child;
+        }
+    }
+
+    /**
+     * @brief Allocate what the next write needs to publish, so that
+     * setBonus() cannot fail.
+     *
+     * @throws std::bad_alloc
+     */
+    void prepare() {
+        if (spare == nullptr) {
+            spare = versions.create();
+        }
+        reserveRetired(1);
+    }
+
+    /**
+     * @brief Insert a student or change its stored points, in O(log n).
+     *
+     * @throws std::bad_alloc with the snapshot unchanged.
+     */
+    void assign(const int id, const int value) {
+        const Version* version = current.load();
+        const Slot entry = {id, value, nullptr};
+        const Node* root;
+        try {
+            root = assignAt(version->root, hash(id), entry, 0);
+        } catch (std::bad_alloc&) {
+            discard();
+            throw;
+        }
+        publish(root, version->bonus);
+    }
+
+    /**
+     * @brief Remove a student, in O(log n).
+     *
+     * @throws std::bad_alloc with the snapshot unchanged.
+     */
+    void remove(const int id) {
+        const Version* version = current.load();
+        const Node* root;
+        try {
+            root = removeAt(version->root, hash(id), id, 0).child;
+        } catch (std::bad_alloc&) {
+            discard();
+            throw;
+        }
+        publish(root, version->bonus);
+    }
+
+    /**
+     * @brief Publish a new bonus offset for every student at once.
+     *
+     * Must follow a successful prepare(), and then cannot fail.
+     */
+    void setBonus(const int bonus) {
+        publish(current.load()->root, bonus);
+    }
+};
+
+#endif //POINTSSNAPSHOT_H
@@ -0,0 +1,193 @@
+// Throughput of ConcurrentTechSystem against TechSystem behind one mutex,
+// for a growing number of client threads.
+//
+// Usage: concurrent_bench [max threads] [ops per thread] [students] [courses]
+//                         [read percent]
+//   max threads       defaults to twice the hardware concurrency
+//   ops per thread    defaults to 500000
+//   students          defaults to 100000
+//   courses           defaults to 1000
+//   read percent      defaults to 40
+//
+// Every thread runs the same mix on random ids: the given share of
+// getStudentPoints, the rest split into 5/12 enrollStudent, 5/12
+// completeCourse, 3/20 addStudent/removeStudent on ids outside the
+// preloaded range and 1/60 awardAcademicPoints.
+
+#include "ConcurrentTechSystem.h"
+#include "TechSystem26a1.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+struct Workload {
+    int opsPerThread;
+    int students;
+    int courses;
+    int readPercent;
+};
+
+enum class OpKind { READ, ENROLL, COMPLETE, ADD_REMOVE, AWARD };
+
+OpKind pickOp(std::mt19937& rng, const Workload& load) {
+    const int roll = int(rng() % 6000);
+    if (roll < load.readPercent * 60) {
+        return OpKind::READ;
+    }
+    // Writes get the remaining rolls, scaled to 0..59.
+    const int write = (roll - load.readPercent * 60) / (100 - load.readPercent);
+    if (write < 25) {
+        return OpKind::ENROLL;
+    }
+    if (write < 50) {
+        return OpKind::COMPLETE;
+    }
+    return write < 59 ? OpKind::ADD_REMOVE : OpKind::AWARD;
+}
+
+// TechSystem with every call serialized, the way a service has to use it.
+class LockedTechSystem {
+public:
+    template <typename Call>
+    int run(Call call) {
+        std::lock_guard<std::mutex> guard(lock);
+        return call(system);
+    }
+
+private:
+    std::mutex lock;
+    TechSystem system;
+};
+
+long long runOps(ConcurrentTechSystem& system, const Workload& load, const int seed) {
+    std::mt19937 rng(seed);
+    long long checksum = 0;
+    for (int i = 0; i < load.opsPerThread; ++i) {
+        const OpKind kind = pickOp(rng, load);
+        const int student = 1 + int(rng() % unsigned(load.students));
+        const int course = 1 + int(rng() % unsigned(load.courses));
+        const int extra = load.students + student;
+        switch (kind) {
+            case OpKind::READ:
+                checksum += system.getStudentPoints(student).ans();
+                break;
+            case OpKind::ENROLL:
+                checksum += int(system.enrollStudent(student, course));
+                break;
+            case OpKind::COMPLETE:
+                checksum += int(system.completeCourse(student, course));
+                break;
+            case OpKind::ADD_REMOVE:
+                checksum += int(i & 1 ? system.addStudent(extra) : system.removeStudent(extra));
+                break;
+            case OpKind::AWARD:
+                checksum += int(system.awardAcademicPoints(1));
+                break;
+        }
+    }
+    return checksum;
+}
+
+long long runOps(LockedTechSystem& system, const Workload& load, const int seed) {
+    std::mt19937 rng(seed);
+    long long checksum = 0;
+    for (int i = 0; i < load.opsPerThread; ++i) {
+        const OpKind kind = pickOp(rng, load);
+        const int student = 1 + int(rng() % unsigned(load.students));
+        const int course = 1 + int(rng() % unsigned(load.courses));
+        const int extra = load.students + student;
+        checksum += system.run([&](TechSystem& locked) {
+            switch (kind) {
+                case OpKind::READ:
+                    return locked.getStudentPoints(student).ans();
+                case OpKind::ENROLL:
+                    return int(locked.enrollStudent(student, course));
+                case OpKind::COMPLETE:
+                    return int(locked.completeCourse(student, course));
+                case OpKind::ADD_REMOVE:
+                    return int(i & 1 ? locked.addStudent(extra) : locked.removeStudent(extra));
+                case OpKind::AWARD:
+                    break;
+            }
+            return int(locked.awardAcademicPoints(1));
+        });
+    }
+    return checksum;
+}
+
+template <typename System>
+void preload(System& system, const Workload& load) {
+    for (int id = 1; id <= load.students; ++id) {
+        system.addStudent(id);
+    }
+    for (int id = 1; id <= load.courses; ++id) {
+        system.addCourse(id, 1 + id % 10);
+    }
+}
+
+void preload(LockedTechSystem& system, const Workload& load) {
+    system.run([&](TechSystem& locked) {
+        preload(locked, load);
+        return 0;
+    });
+}
+
+// Returns millions of operations per second over all threads.
+template <typename System>
+double measure(const Workload& load, const int threads) {
+    System system;
+    preload(system, load);
+    std::vector<std::thread> workers;
+    std::vector<long long> checksums(threads);
+    const Clock::time_point start = Clock::now();
+    for (int t = 0; t < threads; ++t) {
+        workers.emplace_back([&system, &load, &checksums, t]() {
+            checksums[t] = runOps(system, load, 1000 + t);
+        });
+    }
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+    const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    long long total = 0;
+    for (long long checksum : checksums) {
+        total += checksum;
+    }
+    if (total == -1) {
+        std::printf("unreachable\n");
+    }
+    return double(load.opsPerThread) * threads / seconds / 1e6;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    const int hardware = int(std::max(1u, std::thread::hardware_concurrency()));
+    const int maxThreads = argc > 1 ? std::atoi(argv[1]) : 2 * hardware;
+    Workload load;
+    load.opsPerThread = argc > 2 ? std::atoi(argv[2]) : 500000;
+    load.students = argc > 3 ? std::atoi(argv[3]) : 100000;
+    load.courses = argc > 4 ? std::atoi(argv[4]) : 1000;
+    load.readPercent = argc > 5 ? std::atoi(argv[5]) : 40;
+    load.readPercent = std::min(99, std::max(0, load.readPercent));
+
+    std::printf("%d hardware threads, %d ops per thread, %d students, %d courses, %d%% reads\n",
+                hardware, load.opsPerThread, load.students, load.courses, load.readPercent);
+    std::printf("%8s %14s %14s %9s\n", "threads", "locked Mops/s", "sharded Mops/s", "speedup");
+    for (int threads = 1; threads <= maxThreads; threads *= 2) {
+        const double locked = measure<LockedTechSystem>(load, threads);
+        const double sharded = measure<ConcurrentTechSystem>(load, threads);
+        std::printf("%8d %14.2f %14.2f %8.2fx\n", threads, locked, sharded, sharded / locked);
+    }
+    return 0;
+}
@@ -0,0 +1,227 @@
+// Multi-threaded checks of ConcurrentTechSystem against TechSystem.
+//
+// Usage: concurrent_test [seed]
+//
+// Writer threads run random commands on ids of their own, so the result
+// of every command and the final state do not depend on how the threads
+// interleave: they must equal those of a TechSystem running each thread's
+// commands in turn. Student and course ids of all threads still share the
+// shards. Between phases the main thread awards points to everyone.
+//
+// Reader threads meanwhile read watched students, whose points only the
+// completions of their writer change. Every read must give one of the
+// points the sequential run went through in that phase, and a reader must
+// never see them go down.
+//
+// Prints the failed checks and exits 1 if there are any.
+
+#include "concurrent/ConcurrentTechSystem.h"
+#include "TechSystem26a1.h"
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <random>
+#include <set>
+#include <thread>
+#include <vector>
+
+namespace {
+
+const int WRITERS = 4;
+const int READERS = 2;
+const int PHASES = 3;
+const int COMMANDS_PER_PHASE = 20000;
+const int SHARDS = 8;
+// Writer w owns the ids congruent to w, below ID_RANGE.
+const int ID_RANGE = 400;
+// Watched students, added before the first phase, FIRST_WATCHED + i
+// belongs to writer i % WRITERS.
+const int FIRST_WATCHED = 100000;
+const int WATCHED = 32;
+
+std::mutex reportLock;
+std::atomic<int> failures(0);
+
+void check(const bool ok, const char* what, const int line) {
+    if (!ok && failures++ < 20) {
+        std::lock_guard<std::mutex> guard(reportLock);
+        std::fprintf(stderr, "line %d: %s\n", line, what);
+    }
+}
+
+#define CHECK(condition) check(condition, #condition, __LINE__)
+
+int ownedId(std::mt19937& rng, const int writer) {
+    return writer + WRITERS * int(1 + rng() % unsigned(ID_RANGE / WRITERS - 1));
+}
+
+int watchedOf(std::mt19937& rng, const int writer) {
+    return FIRST_WATCHED + writer + WRITERS * int(rng() % unsigned(WATCHED / WRITERS));
+}
+
+// The commands of one writer for one phase, on its own ids only. The
+// watched students enroll in and complete its courses.
+std::vector<TechSystem::Command> writerCommands(std::mt19937& rng, const int writer) {
+    std::vector<TechSystem::Command> commands;
+    for (int i = 0; i < COMMANDS_PER_PHASE; ++i) {
+        TechSystem::Command command = {TechSystem::Opcode::GET_STUDENT_POINTS, 0, 0};
+        const int kind = int(rng() % 100);
+        const int student = ownedId(rng, writer);
+        const int course = ownedId(rng, writer);
+        if (kind < 10) {
+            command = {TechSystem::Opcode::ADD_STUDENT, student, 0};
+        } else if (kind < 14) {
+            command = {TechSystem::Opcode::REMOVE_STUDENT, student, 0};
+        } else if (kind < 20) {
+            command = {TechSystem::Opcode::ADD_COURSE, course, 1 + int(rng() % 9)};
+        } else if (kind < 23) {
+            command = {TechSystem::Opcode::REMOVE_COURSE, course, 0};
+        } else if (kind < 43) {
+            command = {TechSystem::Opcode::ENROLL_STUDENT, student, course};
+        } else if (kind < 58) {
+            command = {TechSystem::Opcode::COMPLETE_COURSE, student, course};
+        } else if (kind < 68) {
+            command = {TechSystem::Opcode::ENROLL_STUDENT, watchedOf(rng, writer), course};
+        } else if (kind < 78) {
+            command = {TechSystem::Opcode::COMPLETE_COURSE, watchedOf(rng, writer), course};
+        } else {
+            command.first = student;
+        }
+        commands.push_back(command);
+    }
+    return commands;
+}
+
+TechSystem::CommandResult run(ConcurrentTechSystem& system, const TechSystem::Command& command) {
+    TechSystem::CommandResult result = {StatusType::SUCCESS, 0};
+    switch (command.opcode) {
+        case TechSystem::Opcode::ADD_STUDENT:
+            result.status = system.addStudent(command.first);
+            break;
+        case TechSystem::Opcode::REMOVE_STUDENT:
+            result.status = system.removeStudent(command.first);
+            break;
+        case TechSystem::Opcode::ADD_COURSE:
+            result.status = system.addCourse(command.first, command.second);
+            break;
+        case TechSystem::Opcode::REMOVE_COURSE:
+            result.status = system.removeCourse(command.first);
+            break;
+        case TechSystem::Opcode::ENROLL_STUDENT:
+            result.status = system.enrollStudent(command.first, command.second);
+            break;
+        case TechSystem::Opcode::COMPLETE_COURSE:
+            result.status = system.completeCourse(command.first, command.second);
+            break;
+        case TechSystem::Opcode::AWARD_ACADEMIC_POINTS:
+            result.status = system.awardAcademicPoints(command.first);
+            break;
+        case TechSystem::Opcode::GET_STUDENT_POINTS: {
+            output_t<int> points = system.getStudentPoints(command.first);
+            result.status = points.status();
+            result.value = points.ans();
+            break;
+        }
+        default:
+            result.status = StatusType::INVALID_INPUT;
+            break;
+    }
+    return result;
+}
+
+int watchedPoints(TechSystem& system, const int id) {
+    output_t<int> points = system.getStudentPoints(id);
+    return points.status() == StatusType::SUCCESS ? points.ans() : -1;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    std::mt19937 rng(argc > 1 ? unsigned(std::strtoul(argv[1], nullptr, 10)) : 2026u);
+    ConcurrentTechSystem concurrent(SHARDS);
+    TechSystem sequential;
+    for (int i = 0; i < WATCHED; ++i) {
+        CHECK(concurrent.addStudent(FIRST_WATCHED + i) == StatusType::SUCCESS);
+        CHECK(sequential.addStudent(FIRST_WATCHED + i) == StatusType::SUCCESS);
+    }
+
+    for (int phase = 0; phase < PHASES; ++phase) {
+        std::vector<std::vector<TechSystem::Command>> commands;
+        for (int writer = 0; writer < WRITERS; ++writer) {
+            commands.push_back(writerCommands(rng, writer));
+        }
+
+        // The expected results, and every value each watched student goes
+        // through during the phase.
+        std::vector<std::vector<TechSystem::CommandResult>> expected(WRITERS);
+        std::vector<std::set<int>> allowed(WATCHED);
+        for (int i = 0; i < WATCHED; ++i) {
+            allowed[i].insert(watchedPoints(sequential, FIRST_WATCHED + i));
+        }
+        for (int writer = 0; writer < WRITERS; ++writer) {
+            for (const TechSystem::Command& command : commands[writer]) {
+                expected[writer].push_back(sequential.apply(command));
+                if (command.first >= FIRST_WATCHED) {
+                    allowed[command.first - FIRST_WATCHED].insert(
+                        watchedPoints(sequential, command.first));
+                }
+            }
+        }
+
+        std::atomic<int> running(WRITERS);
+        std::vector<std::vector<TechSystem::CommandResult>> results(WRITERS);
+        std::vector<std::thread> threads;
+        for (int writer = 0; writer < WRITERS; ++writer) {
+            threads.emplace_back([&, writer]() {
+                for (const TechSystem::Command& command : commands[writer]) {
+                    results[writer].push_back(run(concurrent, command));
+                }
+                running--;
+            });
+        }
+        for (int reader = 0; reader < READERS; ++reader) {
+            threads.emplace_back([&, reader]() {
+                std::mt19937 local(unsigned(phase * READERS + reader));
+                std::vector<int> seen(WATCHED, -1);
+                while (running.load() > 0) {
+                    const int i = int(local() % unsigned(WATCHED));
+                    output_t<int> points = concurrent.getStudentPoints(FIRST_WATCHED + i);
+                    CHECK(points.status() == StatusType::SUCCESS);
+                    CHECK(allowed[i].count(points.ans()) == 1);
+                    CHECK(points.ans() >= seen[i]);
+                    seen[i] = points.ans();
+                }
+            });
+        }
+        for (std::thread& thread : threads) {
+            thread.join();
+        }
+
+        for (int writer = 0; writer < WRITERS; ++writer) {
+            CHECK(results[writer].size() == expected[writer].size());
+            for (size_t i = 0; i < results[writer].size(); ++i) {
+                CHECK(results[writer][i].status == expected[writer][i].status);
+                CHECK(results[writer][i].value == expected[writer][i].value);
+            }
+        }
+        const int award = 1 + int(rng() % 5);
+        CHECK(concurrent.awardAcademicPoints(award) == StatusType::SUCCESS);
+        CHECK(sequential.awardAcademicPoints(award) == StatusType::SUCCESS);
+    }
+
+    // The final state, student by student.
+    for (int id = 1; id < ID_RANGE; ++id) {
+        output_t<int> got = concurrent.getStudentPoints(id);
+        output_t<int> want = sequential.getStudentPoints(id);
+        CHECK(got.status() == want.status());
+        CHECK(got.ans() == want.ans());
+    }
+    for (int i = 0; i < WATCHED; ++i) {
+        CHECK(concurrent.getStudentPoints(FIRST_WATCHED + i).ans() ==
+              watchedPoints(sequential, FIRST_WATCHED + i));
+    }
+    std::printf("concurrent %s\n", failures == 0 ? "ok" : "FAILED");
+    return failures == 0 ? 0 : 1;
+}
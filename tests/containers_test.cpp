@@ -0,0 +1,516 @@
+// Randomized checks of the index containers against a sorted-array model.
+//
+// Usage: containers_test [seed]
+//
+// Tree: inserts and removes, rank/select/countInRange at the boundaries,
+// iterators both ways, lowerBound and range cursors, paging that resumes
+// after the tree changed under an earlier iterator, and join, split and
+// merge between trees of very different heights. Heights are checked
+// against the AVL bound through a TreeStats policy.
+// HashIndex: churn that keeps tables growing, removes while a migration
+// is in progress, and probe runs that wrap around the end of the table.
+// BPlusTree: churn, and inserts whose split fails to allocate, with the
+// size and in-order listing a HashIndex stand-in needs.
+// StudentStore: every chunk aligned to its size, and every field of every
+// slot found from the handle alone, through reuse of freed slots.
+//
+// Prints the failed checks of each part and exits 1 if there are any.
+
+#include "Tree.h"
+#include "HashIndex.h"
+#include "BPlusTree.h"
+#include "StudentStore.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+namespace {
+
+int failures = 0;
+const char* part = "";
+
+void check(const bool ok, const char* what, const int line) {
+    if (!ok && failures++ < 20) {
+        std::fprintf(stderr, "%s, line %d: %s\n", part, line, what);
+    }
+}
+
+#define CHECK(condition) check(condition, #condition, __LINE__)
+
+// A handle whose key is its value.
+struct Id {
+    int value;
+
+    int operator*() const {
+        return value;
+    }
+};
+
+struct TestTag;
+typedef Tree<Id, PoolAllocator, true, TreeStats<TestTag>> RankedTree;
+typedef std::vector<int> Model;
+
+std::mt19937 rng;
+
+int pick(const int low, const int high) {
+    return std::uniform_int_distribution<int>(low, high)(rng);
+}
+
+bool contains(const Model& model, const int key) {
+    return std::binary_search(model.begin(), model.end(), key);
+}
+
+void modelInsert(Model& model, const int key) {
+    model.insert(std::lower_bound(model.begin(), model.end(), key), key);
+}
+
+void modelRemove(Model& model, const int key) {
+    model.erase(std::lower_bound(model.begin(), model.end(), key));
+}
+
+// Tallest an AVL tree of count keys can be, a leaf has height 1.
+bool withinAvlHeight(const RankedTree& tree, const int count) {
+    return tree.stats().counters().maxHeight <= 1.4405 * std::log2(count + 2.0);
+}
+
+Model contents(const RankedTree& tree) {
+    Model keys;
+    for (RankedTree::Iterator it = tree.begin(); it != tree.end(); ++it) {
+        keys.push_back(**it);
+    }
+    return keys;
+}
+
+RankedTree* build(const Model& keys) {
+    RankedTree* tree = new RankedTree();
+    std::vector<int> order(keys);
+    std::shuffle(order.begin(), order.end(), rng);
+    for (int key : order) {
+        tree->tryInsert(Id{key});
+    }
+    return tree;
+}
+
+// Distinct sorted keys in [low, high].
+Model randomKeys(const int count, const int low, const int high) {
+    Model keys;
+    for (int i = 0; i < count; ++i) {
+        keys.push_back(pick(low, high));
+    }
+    std::sort(keys.begin(), keys.end());
+    keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+    return keys;
+}
+
+void checkOrderStatistics(const RankedTree& tree, const Model& model) {
+    const int size = int(model.size());
+    CHECK(tree.size() == size);
+    CHECK(tree.select(-1) == nullptr);
+    CHECK(tree.select(size) == nullptr);
+    if (size > 0) {
+        CHECK(tree.select(0)->value == model.front());
+        CHECK(tree.select(size - 1)->value == model.back());
+        CHECK(tree.rank(model.front()) == 0);
+        CHECK(tree.rank(model.back()) == size - 1);
+        CHECK(tree.rank(model.front() - 1) == 0);
+        CHECK(tree.rank(model.back() + 1) == size);
+        CHECK(tree.countInRange(model.front(), model.back()) == size);
+    }
+    for (int i = 0; i < 20; ++i) {
+        const int key = pick(-10, 1010);
+        const int below = int(std::lower_bound(model.begin(), model.end(), key) - model.begin());
+        CHECK(tree.rank(key) == below);
+        if (size > 0) {
+            const int index = pick(0, size - 1);
+            CHECK(tree.select(index)->value == model[index]);
+        }
+        const int low = pick(-10, 1010);
+        const int high = pick(-10, 1010);
+        const int inRange = low > high ? 0 :
+            int(std::upper_bound(model.begin(), model.end(), high) -
+                std::lower_bound(model.begin(), model.end(), low));
+        CHECK(tree.countInRange(low, high) == inRange);
+
+        Model ranged;
+        for (RankedTree::RangeCursor cursor = tree.range(low, high); !cursor.isDone(); ++cursor) {
+            ranged.push_back(**cursor);
+        }
+        CHECK(int(ranged.size()) == inRange);
+        CHECK(std::is_sorted(ranged.begin(), ranged.end()));
+
+        RankedTree::Iterator bound = tree.lowerBound(key);
+        const Model::const_iterator expected = std::lower_bound(model.begin(), model.end(), key);
+        CHECK((bound == tree.end()) == (expected == model.end()));
+        if (bound != tree.end() && expected != model.end()) {
+            CHECK(**bound == *expected);
+        }
+    }
+}
+
+void checkIterators(const RankedTree& tree, const Model& model) {
+    CHECK(contents(tree) == model);
+    Model backwards;
+    RankedTree::Iterator it = tree.end();
+    for (--it; it != tree.end(); --it) {
+        backwards.push_back(**it);
+    }
+    std::reverse(backwards.begin(), backwards.end());
+    CHECK(backwards == model);
+}
+
+void testTreeChurn() {
+    part = "Tree churn";
+    for (int round = 0; round < 40; ++round) {
+        RankedTree tree;
+        Model model;
+        int largest = 0;
+        const int range = pick(1, 1000);
+        for (int step = 0; step < 2000; ++step) {
+            const int key = pick(0, range);
+            if (pick(0, 2) > 0) {
+                const bool added = tree.tryInsert(Id{key}) == TreeResult::SUCCESS;
+                CHECK(added != contains(model, key));
+                if (added) {
+                    modelInsert(model, key);
+                }
+            } else {
+                const bool removed = tree.tryRemove(key) == TreeResult::SUCCESS;
+                CHECK(removed == contains(model, key));
+                if (removed) {
+                    modelRemove(model, key);
+                }
+            }
+            largest = std::max(largest, int(model.size()));
+            CHECK((tree.tryFind(key) != nullptr) == contains(model, key));
+            if (step % 200 == 0) {
+                checkOrderStatistics(tree, model);
+                checkIterators(tree, model);
+            }
+        }
+        checkOrderStatistics(tree, model);
+        checkIterators(tree, model);
+        CHECK(withinAvlHeight(tree, largest));
+    }
+}
+
+// Iterators are invalidated by any change, so a pager remembers the last
+// key it returned and starts the next page at lowerBound(last + 1). Each
+// page must match the tree as it is by then, whatever changed before.
+void testTreePaging() {
+    part = "Tree paging";
+    for (int round = 0; round < 40; ++round) {
+        Model model = randomKeys(pick(0, 500), 0, 1000);
+        RankedTree* tree = build(model);
+        int next = 0;
+        bool done = false;
+        while (!done) {
+            Model page;
+            RankedTree::Iterator it = tree->lowerBound(next);
+            for (; int(page.size()) < 7 && it != tree->end(); ++it) {
+                page.push_back(**it);
+            }
+            const Model::const_iterator from = std::lower_bound(model.begin(), model.end(), next);
+            const Model expected(from, from + std::min<long>(7, model.end() - from));
+            CHECK(page == expected);
+            done = it == tree->end();
+            next = page.empty() ? next : page.back() + 1;
+            // Change the tree on both sides of the page boundary.
+            for (int i = 0; i < 3; ++i) {
+                const int key = pick(std::max(0, next - 20), next + 20);
+                if (contains(model, key)) {
+                    tree->tryRemove(key);
+                    modelRemove(model, key);
+                } else {
+                    tree->tryInsert(Id{key});
+                    modelInsert(model, key);
+                }
+            }
+        }
+        checkIterators(*tree, model);
+        delete tree;
+    }
+}
+
+void testTreeJoinSplitMerge() {
+    part = "Tree join/split/merge";
+    for (int round = 0; round < 300; ++round) {
+        // Sides of very different sizes, so the heights differ a lot.
+        const int leftCount = pick(0, 3) == 0 ? pick(0, 3) : pick(0, 2000);
+        const int rightCount = pick(0, 3) == 0 ? pick(0, 3) : pick(0, 2000);
+        const Model left = randomKeys(leftCount, 0, 100000);
+        const Model right = randomKeys(rightCount, 200001, 300000);
+        const int pivot = pick(100001, 200000);
+
+        RankedTree* joined = build(left);
+        RankedTree* larger = build(right);
+        CHECK(joined->join(Id{pivot}, *larger) == TreeResult::SUCCESS);
+        CHECK(larger->isEmpty());
+        Model all(left);
+        all.push_back(pivot);
+        all.insert(all.end(), right.begin(), right.end());
+        checkIterators(*joined, all);
+        CHECK(joined->size() == int(all.size()));
+        CHECK(withinAvlHeight(*joined, int(all.size())));
+
+        // A pivot on the wrong side changes nothing.
+        RankedTree other;
+        other.tryInsert(Id{0});
+        if (!all.empty()) {
+            CHECK(joined->join(Id{all.back()}, other) == TreeResult::OUT_OF_ORDER);
+            CHECK(other.size() == 1);
+            CHECK(contents(*joined) == all);
+        }
+
+        // Split at a present or an absent key.
+        const int at = pick(0, 1) == 0 && !all.empty() ? all[pick(0, int(all.size()) - 1)] :
+                                                          pick(-5, 300005);
+        RankedTree less;
+        RankedTree greater;
+        const bool present = contains(all, at);
+        CHECK((joined->split(at, less, greater) == TreeResult::SUCCESS) == present);
+        const Model::const_iterator cut = std::lower_bound(all.begin(), all.end(), at);
+        CHECK(contents(less) == Model(all.cbegin(), cut));
+        CHECK(contents(greater) == Model(cut + (present ? 1 : 0), all.cend()));
+        CHECK(contents(*joined) == (present ? Model(1, at) : Model()));
+        CHECK(withinAvlHeight(less, less.size()));
+        CHECK(withinAvlHeight(greater, greater.size()));
+        checkOrderStatistics(less, Model(all.cbegin(), cut));
+
+        // Merge overlapping trees, duplicates are reported once each.
+        const Model first = randomKeys(pick(0, 1500), 0, 3000);
+        const Model second = randomKeys(pick(0, 1500), 0, 3000);
+        RankedTree* into = build(first);
+        RankedTree* from = build(second);
+        Model duplicates;
+        into->merge(*from, [&duplicates](const Id& id) { duplicates.push_back(id.value); });
+        Model expectedDuplicates;
+        std::set_intersection(first.begin(), first.end(), second.begin(), second.end(),
+                              std::back_inserter(expectedDuplicates));
+        std::sort(duplicates.begin(), duplicates.end());
+        CHECK(duplicates == expectedDuplicates);
+        Model merged;
+        std::set_union(first.begin(), first.end(), second.begin(), second.end(),
+                       std::back_inserter(merged));
+        CHECK(from->isEmpty());
+        checkIterators(*into, merged);
+        checkOrderStatistics(*into, merged);
+        CHECK(withinAvlHeight(*into, int(merged.size())));
+
+        delete joined;
+        delete larger;
+        delete into;
+        delete from;
+    }
+}
+
+// Keys whose home slot is among the last two of a table with 2^bits
+// slots, by the same Fibonacci hashing as HashIndex, so their probe runs
+// wrap around to the start of the table.
+Model wrappingKeys(const int bits, const int count) {
+    Model keys;
+    for (int key = 1; int(keys.size()) < count; ++key) {
+        const unsigned home = (unsigned(key) * 2654435769u) >> (32 - bits);
+        if (home + 2 >= (1u << bits)) {
+            keys.push_back(key);
+        }
+    }
+    return keys;
+}
+
+void testHashIndex() {
+    part = "HashIndex";
+    for (int round = 0; round < 60; ++round) {
+        HashIndex<Id> table;
+        Model model;
+        // Small tables see wrap-around runs, long churn keeps growing.
+        const bool wrapping = round % 3 == 0;
+        const Model pool = wrapping ? wrappingKeys(4 + round % 4, 40) : randomKeys(5000, 1, 20000);
+        const int steps = wrapping ? 400 : 12000;
+        for (int step = 0; step < steps; ++step) {
+            const int key = pool[pick(0, int(pool.size()) - 1)];
+            // Growth first, removes later, so removes also hit migrations.
+            const bool insert = pick(0, 99) < (step < steps / 2 ? 70 : 40);
+            if (insert) {
+                const bool added = table.tryInsert(Id{key}) == TreeResult::SUCCESS;
+                CHECK(added != contains(model, key));
+                if (added) {
+                    modelInsert(model, key);
+                }
+            } else {
+                const bool removed = table.tryRemove(key) == TreeResult::SUCCESS;
+                CHECK(removed == contains(model, key));
+                if (removed) {
+                    modelRemove(model, key);
+                }
+            }
+            CHECK(table.size() == int(model.size()));
+            if (wrapping || step % 500 == 0) {
+                for (int probe : pool) {
+                    const Id* found = table.tryFind(probe);
+                    CHECK((found != nullptr) == contains(model, probe));
+                    CHECK(found == nullptr || found->value == probe);
+                }
+                Model listed;
+                table.forEach([&listed](const Id& id) { listed.push_back(id.value); });
+                std::sort(listed.begin(), listed.end());
+                CHECK(listed == model);
+            }
+        }
+        if (round % 2 == 0) {
+            table.reserve(int(model.size()) * 3);
+            for (int probe : pool) {
+                CHECK((table.tryFind(probe) != nullptr) == contains(model, probe));
+            }
+        }
+    }
+}
+
+// Allocation policy that fails once the budget of creations runs out.
+long allocationBudget = -1;
+
+template <typename N>
+struct FailingAllocator
+{
+    template <typename... Args>
+    static N* create(Args&&... args) {
+        if (allocationBudget == 0) {
+            throw std::bad_alloc();
+        }
+        if (allocationBudget > 0) {
+            allocationBudget--;
+        }
+        return new N(std::forward<Args>(args)...);
+    }
+
+    static void destroy(N* node) {
+        delete node;
+    }
+};
+
+void testBPlusTree() {
+    part = "BPlusTree";
+    for (int round = 0; round < 100; ++round) {
+        // A small fanout, so splits reach the root often.
+        BPlusTree<Id, FailingAllocator, 4> tree;
+        Model model;
+        for (int step = 0; step < 3000; ++step) {
+            const int key = pick(0, 2000);
+            if (pick(0, 2) > 0) {
+                allocationBudget = pick(0, 3) == 0 ? pick(0, 2) : -1;
+                try {
+                    const bool added = tree.tryInsert(Id{key}) == TreeResult::SUCCESS;
+                    CHECK(added != contains(model, key));
+                    if (added) {
+                        modelInsert(model, key);
+                    }
+                } catch (std::bad_alloc&) {
+                    // The tree must be unchanged, checked below.
+                }
+                allocationBudget = -1;
+            } else {
+                const bool removed = tree.tryRemove(key) == TreeResult::SUCCESS;
+                CHECK(removed == contains(model, key));
+                if (removed) {
+                    modelRemove(model, key);
+                }
+            }
+            CHECK(tree.size() == int(model.size()));
+        }
+        for (int key = 0; key <= 2000; ++key) {
+            const Id* found = tree.tryFind(key);
+            CHECK((found != nullptr) == contains(model, key));
+        }
+        Model listed;
+        tree.forEach([&listed](const Id& id) { listed.push_back(id.value); });
+        CHECK(listed == model);
+    }
+}
+
+// A course index that records its construction, for the store to keep.
+struct Courses {
+    int value = -1;
+};
+
+void testStudentStore() {
+    part = "StudentStore";
+    typedef StudentStore<Courses> Store;
+    const std::uintptr_t mask = ~(std::uintptr_t(Store::CHUNK_BYTES) - 1);
+    const int before = failures;
+    for (int round = 0; round < 4; ++round) {
+        Store store;
+        // Each chunk, first to last column, lies within one aligned block.
+        // Checked first, the field accessors below rely on it.
+        for (int i = 0; i < Store::SLOTS_PER_CHUNK * 3; ++i) {
+            store.create(i + 1, 0);
+        }
+        for (int chunk = 0; chunk < store.chunksUsed(); ++chunk) {
+            const std::uintptr_t first = reinterpret_cast<std::uintptr_t>(store.idColumn(chunk));
+            const std::uintptr_t last = reinterpret_cast<std::uintptr_t>(
+                store.courseCountColumn(chunk) + Store::SLOTS_PER_CHUNK - 1);
+            CHECK((first & mask) == (last & mask));
+            CHECK(first - (first & mask) < 64);
+        }
+        if (failures > before) {
+            return;
+        }
+        store.clear([](StudentHandle) {});
+
+        std::vector<StudentHandle> handles;
+        std::vector<int> ids;
+        const int count = Store::SLOTS_PER_CHUNK * (2 + round) + pick(0, 100);
+        for (int step = 0; step < 3 * count; ++step) {
+            if (handles.empty() || (int(handles.size()) < count && pick(0, 3) > 0)) {
+                const int id = int(handles.size()) + 1 + step * 8;
+                const StudentHandle student = store.create(id, -id);
+                CHECK(store.courses(student).value == -1);
+                store.courses(student).value = id;
+                store.courseCount(student) = id % 7;
+                handles.push_back(student);
+                ids.push_back(id);
+            } else {
+                const int at = pick(0, int(handles.size()) - 1);
+                store.destroy(handles[at]);
+                handles[at] = handles.back();
+                ids[at] = ids.back();
+                handles.pop_back();
+                ids.pop_back();
+            }
+        }
+        CHECK(store.size() == int(handles.size()));
+
+        std::vector<bool> slots(size_t(store.chunksUsed()) * Store::SLOTS_PER_CHUNK, false);
+        for (size_t i = 0; i < handles.size(); ++i) {
+            const StudentHandle student = handles[i];
+            CHECK(*student == ids[i]);
+            CHECK(store.points(student) == -ids[i]);
+            CHECK(store.courseCount(student) == ids[i] % 7);
+            CHECK(store.courses(student).value == ids[i]);
+            const int slot = store.slotOf(student);
+            CHECK(slot >= 0 && slot < int(slots.size()) && !slots[slot]);
+            if (slot >= 0 && slot < int(slots.size())) {
+                slots[slot] = true;
+                const int chunk = slot / Store::SLOTS_PER_CHUNK;
+                CHECK(store.idColumn(chunk)[slot % Store::SLOTS_PER_CHUNK] == ids[i]);
+            }
+        }
+    }
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    rng.seed(argc > 1 ? unsigned(std::strtoul(argv[1], nullptr, 10)) : 2026u);
+    void (*const parts[])() = {testTreeChurn, testTreePaging, testTreeJoinSplitMerge,
+                               testHashIndex, testBPlusTree, testStudentStore};
+    for (void (*run)() : parts) {
+        const int before = failures;
+        run();
+        std::printf("%-24s %s\n", part, failures == before ? "ok" : "FAILED");
+    }
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,16 @@
+# Runs DRIVER with INPUT on stdin and compares its output to EXPECTED.
+#
+# Usage: cmake -DDRIVER=<exe> -DINPUT=<test.in> -DEXPECTED=<test.out> -P golden.cmake
+
+execute_process(COMMAND ${DRIVER}
+                INPUT_FILE ${INPUT}
+                OUTPUT_VARIABLE actual
+                RESULT_VARIABLE status)
+file(READ ${EXPECTED} expected)
+
+if(NOT status EQUAL 0)
+    message(FATAL_ERROR "${DRIVER} exited with ${status} on ${INPUT}")
+endif()
+if(NOT actual STREQUAL expected)
+    message(FATAL_ERROR "${DRIVER} output differs from ${EXPECTED}")
+endif()
@@ -0,0 +1,34 @@
+# Encodes INPUT as a command log, replays it and compares the printed
+# results to EXPECTED. The final state must also survive a snapshot round
+# trip, and a recovery from a snapshot and a write-ahead log.
+#
+# Usage: cmake -DCOMMAND_LOG=<exe> -DINPUT=<test.in> -DEXPECTED=<test.out>
+#              -DWORK_DIR=<dir> -P replay.cmake
+
+get_filename_component(name ${INPUT} NAME_WE)
+set(commands ${WORK_DIR}/${name}.tscl)
+set(results ${WORK_DIR}/${name}.tscr)
+set(snapshot ${WORK_DIR}/${name}.tssn)
+set(durable ${WORK_DIR}/${name}.durable.tssn)
+set(wal ${WORK_DIR}/${name}.wal)
+
+foreach(step "encode;${INPUT};${commands}" "replay;${commands};${results}"
+             "checkpoint;${commands};${snapshot}"
+             "durable;${commands};${durable};${wal};n=16")
+    execute_process(COMMAND ${COMMAND_LOG} ${step} RESULT_VARIABLE status)
+    if(NOT status EQUAL 0)
+        message(FATAL_ERROR "command_log ${step} failed with ${status}")
+    endif()
+endforeach()
+
+execute_process(COMMAND ${COMMAND_LOG} print ${commands} ${results}
+                OUTPUT_VARIABLE actual
+                RESULT_VARIABLE status)
+file(READ ${EXPECTED} expected)
+
+if(NOT status EQUAL 0)
+    message(FATAL_ERROR "command_log print failed with ${status}")
+endif()
+if(NOT actual STREQUAL expected)
+    message(FATAL_ERROR "replayed results differ from ${EXPECTED}")
+endif()
@@ -0,0 +1,628 @@
+// Randomized checks of TechSystem against a brute-force model.
+//
+// Usage: system_test [seed]
+//
+// Every command runs on a TechSystem and on a model that keeps plain
+// maps and sets, and the statuses, answers and whole states must agree.
+// Covered beyond the commands of main26a1.cpp: withdrawStudent, the forced
+// removeCourse with and without points, mergeCourses, awardCoursePoints
+// with its lazy settlement, the leaderboard queries, and applyBatch, whose
+// results and final state must match running the same commands one by one
+// through apply(). Snapshots are loaded next to other live systems, which
+// must not be affected. The snapshot file is written in the working
+// directory.
+//
+// Prints the failed checks of each part and exits 1 if there are any.
+
+#include "TechSystem26a1.h"
+
+#include <algorithm>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <memory>
+#include <random>
+#include <set>
+#include <utility>
+#include <vector>
+
+namespace {
+
+int failures = 0;
+const char* part = "";
+
+void check(const bool ok, const char* what, const int line) {
+    if (!ok && failures++ < 20) {
+        std::fprintf(stderr, "%s, line %d: %s\n", part, line, what);
+    }
+}
+
+#define CHECK(condition) check(condition, #condition, __LINE__)
+
+std::mt19937 rng;
+
+int pick(const int low, const int high) {
+    return std::uniform_int_distribution<int>(low, high)(rng);
+}
+
+// What the methods of TechSystem document, the slow and obvious way.
+class Model {
+public:
+    struct Course {
+        int points;
+        std::set<int> roster;
+    };
+
+    std::map<int, int> students; // id to points.
+    std::map<int, Course> courses;
+
+    StatusType addStudent(const int id) {
+        if (id <= 0) {return StatusType::INVALID_INPUT;}
+        return students.emplace(id, 0).second ? StatusType::SUCCESS : StatusType::FAILURE;
+    }
+
+    StatusType removeStudent(const int id) {
+        if (id <= 0) {return StatusType::INVALID_INPUT;}
+        if (students.count(id) == 0 || enrolled(id)) {
+            return StatusType::FAILURE;
+        }
+        students.erase(id);
+        return StatusType::SUCCESS;
+    }
+
+    StatusType addCourse(const int id, const int points) {
+        if (id <= 0 || points <= 0) {return StatusType::INVALID_INPUT;}
+        return courses.emplace(id, Course{points, {}}).second ? StatusType::SUCCESS :
+                                                                StatusType::FAILURE;
+    }
+
+    StatusType removeCourse(const int id) {
+        if (id <= 0) {return StatusType::INVALID_INPUT;}
+        if (courses.count(id) == 0 || !courses[id].roster.empty()) {
+            return StatusType::FAILURE;
+        }
+        courses.erase(id);
+        return StatusType::SUCCESS;
+    }
+
+    StatusType enrollStudent(const int student, const int course) {
+        if (student <= 0 || course <= 0) {return StatusType::INVALID_INPUT;}
+        if (courses.count(course) == 0 || students.count(student) == 0) {
+            return StatusType::FAILURE;
+        }
+        return courses[course].roster.insert(student).second ? StatusType::SUCCESS :
+                                                                StatusType::FAILURE;
+    }
+
+    StatusType completeCourse(const int student, const int course) {
+        if (student <= 0 || course <= 0) {return StatusType::INVALID_INPUT;}
+        if (courses.count(course) == 0 || courses[course].roster.erase(student) == 0) {
+            return StatusType::FAILURE;
+        }
+        students[student] += courses[course].points;
+        return StatusType::SUCCESS;
+    }
+
+    StatusType awardAcademicPoints(const int points) {
+        if (points <= 0) {return StatusType::INVALID_INPUT;}
+        for (auto& student : students) {
+            student.second += points;
+        }
+        return StatusType::SUCCESS;
+    }
+
+    StatusType getStudentPoints(const int id, int& points) {
+        if (id <= 0) {return StatusType::INVALID_INPUT;}
+        if (students.count(id) == 0) {
+            return StatusType::FAILURE;
+        }
+        points = students[id];
+        return StatusType::SUCCESS;
+    }
+
+    StatusType withdrawStudent(const int id) {
+        if (id <= 0) {return StatusType::INVALID_INPUT;}
+        if (students.count(id) == 0) {
+            return StatusType::FAILURE;
+        }
+        for (auto& course : courses) {
+            course.second.roster.erase(id);
+        }
+        return StatusType::SUCCESS;
+    }
+
+    StatusType awardCoursePoints(const int id, const int points) {
+        if (id <= 0 || points <= 0) {return StatusType::INVALID_INPUT;}
+        if (courses.count(id) == 0) {
+            return StatusType::FAILURE;
+        }
+        for (const int student : courses[id].roster) {
+            students[student] += points;
+        }
+        return StatusType::SUCCESS;
+    }
+
+    StatusType forceRemoveCourse(const int id, const bool awardPoints) {
+        if (id <= 0) {return StatusType::INVALID_INPUT;}
+        if (courses.count(id) == 0) {
+            return StatusType::FAILURE;
+        }
+        for (const int student : courses[id].roster) {
+            students[student] += awardPoints ? courses[id].points : 0;
+        }
+        courses.erase(id);
+        return StatusType::SUCCESS;
+    }
+
+    StatusType mergeCourses(const int source, const int target) {
+        if (source <= 0 || target <= 0 || source == target) {
+            return StatusType::INVALID_INPUT;
+        }
+        if (courses.count(source) == 0 || courses.count(target) == 0) {
+            return StatusType::FAILURE;
+        }
+        courses[target].roster.insert(courses[source].roster.begin(),
+                                      courses[source].roster.end());
+        courses[source].roster.clear();
+        return StatusType::SUCCESS;
+    }
+
+    TechSystem::CommandResult apply(const TechSystem::Command& command) {
+        TechSystem::CommandResult result = {StatusType::SUCCESS, 0};
+        switch (command.opcode) {
+            case TechSystem::Opcode::ADD_STUDENT:
+                result.status = addStudent(command.first);
+                break;
+            case TechSystem::Opcode::REMOVE_STUDENT:
+                result.status = removeStudent(command.first);
+                break;
+            case TechSystem::Opcode::ADD_COURSE:
+                result.status = addCourse(command.first, command.second);
+                break;
+            case TechSystem::Opcode::REMOVE_COURSE:
+                result.status = removeCourse(command.first);
+                break;
+            case TechSystem::Opcode::ENROLL_STUDENT:
+                result.status = enrollStudent(command.first, command.second);
+                break;
+            case TechSystem::Opcode::COMPLETE_COURSE:
+                result.status = completeCourse(command.first, command.second);
+                break;
+            case TechSystem::Opcode::AWARD_ACADEMIC_POINTS:
+                result.status = awardAcademicPoints(command.first);
+                break;
+            case TechSystem::Opcode::GET_STUDENT_POINTS:
+                result.status = getStudentPoints(command.first, result.value);
+                break;
+            case TechSystem::Opcode::WITHDRAW_STUDENT:
+                result.status = withdrawStudent(command.first);
+                break;
+            case TechSystem::Opcode::FORCE_REMOVE_COURSE:
+                result.status = forceRemoveCourse(command.first, command.second != 0);
+                break;
+            case TechSystem::Opcode::MERGE_COURSES:
+                result.status = mergeCourses(command.first, command.second);
+                break;
+            case TechSystem::Opcode::AWARD_COURSE_POINTS:
+                result.status = awardCoursePoints(command.first, command.second);
+                break;
+        }
+        return result;
+    }
+
+private:
+    bool enrolled(const int student) const {
+        for (const auto& course : courses) {
+            if (course.second.roster.count(student) > 0) {
+                return true;
+            }
+        }
+        return false;
+    }
+};
+
+// Ids are drawn from small ranges, with a few invalid ones, so that
+// commands keep meeting existing students and courses.
+struct Ranges {
+    int students;
+    int courses;
+};
+
+int studentId(const Ranges& ranges) {
+    return pick(0, 30) == 0 ? -pick(0, 1) : pick(1, ranges.students);
+}
+
+int courseId(const Ranges& ranges) {
+    return pick(0, 30) == 0 ? -pick(0, 1) : pick(1, ranges.courses);
+}
+
+TechSystem::Command randomCommand(const Ranges& ranges) {
+    TechSystem::Command command = {TechSystem::Opcode::GET_STUDENT_POINTS, 0, 0};
+    const int kind = pick(0, 99);
+    if (kind < 12) {
+        command.opcode = TechSystem::Opcode::ADD_STUDENT;
+        command.first = studentId(ranges);
+    } else if (kind < 16) {
+        command.opcode = TechSystem::Opcode::REMOVE_STUDENT;
+        command.first = studentId(ranges);
+    } else if (kind < 24) {
+        command.opcode = TechSystem::Opcode::ADD_COURSE;
+        command.first = courseId(ranges);
+        command.second = pick(-1, 9);
+    } else if (kind < 27) {
+        command.opcode = TechSystem::Opcode::REMOVE_COURSE;
+        command.first = courseId(ranges);
+    } else if (kind < 57) {
+        command.opcode = TechSystem::Opcode::ENROLL_STUDENT;
+        command.first = studentId(ranges);
+        command.second = courseId(ranges);
+    } else if (kind < 75) {
+        command.opcode = TechSystem::Opcode::COMPLETE_COURSE;
+        command.first = studentId(ranges);
+        command.second = courseId(ranges);
+    } else if (kind < 78) {
+        command.opcode = TechSystem::Opcode::AWARD_ACADEMIC_POINTS;
+        command.first = pick(-1, 5);
+    } else if (kind < 80) {
+        command.opcode = TechSystem::Opcode::WITHDRAW_STUDENT;
+        command.first = studentId(ranges);
+    } else if (kind < 81) {
+        command.opcode = TechSystem::Opcode::FORCE_REMOVE_COURSE;
+        command.first = courseId(ranges);
+        command.second = pick(0, 2);
+    } else if (kind < 83) {
+        command.opcode = TechSystem::Opcode::MERGE_COURSES;
+        command.first = courseId(ranges);
+        command.second = courseId(ranges);
+    } else if (kind < 85) {
+        command.opcode = TechSystem::Opcode::AWARD_COURSE_POINTS;
+        command.first = courseId(ranges);
+        command.second = pick(-1, 5);
+    } else {
+        command.first = studentId(ranges);
+    }
+    return command;
+}
+
+bool sameResult(const TechSystem::CommandResult& a, const TechSystem::CommandResult& b) {
+    return a.status == b.status && a.value == b.value;
+}
+
+// The whole observable state: every student with its points, and every
+// course id in range with its roster.
+void checkState(TechSystem& system, const Model& model, const Ranges& ranges) {
+    std::vector<int> ids(model.students.size() + 1);
+    std::vector<int> points(model.students.size() + 1);
+    output_t<int> listed = system.getStudentsPoints(0, ids.data(), points.data(),
+                                                    int(ids.size()));
+    CHECK(listed.status() == StatusType::SUCCESS);
+    CHECK(listed.ans() == int(model.students.size()));
+    int i = 0;
+    for (const auto& student : model.students) {
+        if (i < listed.ans()) {
+            CHECK(ids[i] == student.first);
+            CHECK(points[i] == student.second);
+        }
+        ++i;
+    }
+    std::vector<int> roster(model.students.size() + 1);
+    for (int course = 1; course <= ranges.courses; ++course) {
+        output_t<int> got = system.getCourseRoster(course, 0, roster.data(),
+                                                   int(roster.size()));
+        const auto found = model.courses.find(course);
+        CHECK((got.status() == StatusType::SUCCESS) == (found != model.courses.end()));
+        if (found != model.courses.end() && got.status() == StatusType::SUCCESS) {
+            CHECK(std::vector<int>(roster.begin(), roster.begin() + got.ans()) ==
+                  std::vector<int>(found->second.roster.begin(), found->second.roster.end()));
+        }
+    }
+}
+
+Ranges randomRanges() {
+    return Ranges{pick(1, 60), pick(1, 15)};
+}
+
+void runCommands(TechSystem& system, Model& model, const Ranges& ranges, const int steps) {
+    for (int step = 0; step < steps; ++step) {
+        const TechSystem::Command command = randomCommand(ranges);
+        CHECK(sameResult(system.apply(command), model.apply(command)));
+    }
+}
+
+void testCommands() {
+    part = "commands";
+    for (int round = 0; round < 30; ++round) {
+        const Ranges ranges = randomRanges();
+        TechSystem system;
+        Model model;
+        runCommands(system, model, ranges, 3000);
+        checkState(system, model, ranges);
+    }
+}
+
+// One random call of any kind: the basic commands, or less often
+// withdrawStudent, the forced removeCourse, mergeCourses and, with
+// courseAwards set, awardCoursePoints.
+void randomStep(TechSystem& system, Model& model, const Ranges& ranges,
+                const bool courseAwards) {
+    const int kind = pick(0, 19);
+    if (kind == 0) {
+        const int id = studentId(ranges);
+        CHECK(system.withdrawStudent(id) == model.withdrawStudent(id));
+    } else if (kind == 1) {
+        const int id = courseId(ranges);
+        const bool awardPoints = pick(0, 1) == 1;
+        CHECK(system.removeCourse(id, true, awardPoints) ==
+              model.forceRemoveCourse(id, awardPoints));
+    } else if (kind == 2) {
+        // Not forced, the plain removeCourse.
+        const int id = courseId(ranges);
+        CHECK(system.removeCourse(id, false, true) == model.removeCourse(id));
+    } else if (kind == 3) {
+        const int source = courseId(ranges);
+        const int target = pick(0, 5) == 0 ? source : courseId(ranges);
+        CHECK(system.mergeCourses(source, target) == model.mergeCourses(source, target));
+    } else if (kind == 4 && courseAwards) {
+        const int id = courseId(ranges);
+        const int points = pick(-1, 5);
+        CHECK(system.awardCoursePoints(id, points) == model.awardCoursePoints(id, points));
+    } else {
+        const TechSystem::Command command = randomCommand(ranges);
+        CHECK(sameResult(system.apply(command), model.apply(command)));
+    }
+}
+
+// A withdrawn student has no course left and can be removed.
+void withdrawAll(TechSystem& system, const Model& model) {
+    for (const auto& student : model.students) {
+        CHECK(system.withdrawStudent(student.first) == StatusType::SUCCESS);
+        CHECK(system.removeStudent(student.first) == StatusType::SUCCESS);
+    }
+}
+
+// withdrawStudent and the forced removeCourse, mixed into the basic
+// commands, and mergeCourses, which they interact with.
+void testWithdrawAndForcedRemove() {
+    part = "withdraw/forced remove";
+    for (int round = 0; round < 30; ++round) {
+        const Ranges ranges = randomRanges();
+        TechSystem system;
+        Model model;
+        for (int step = 0; step < 3000; ++step) {
+            randomStep(system, model, ranges, false);
+            if (step % 500 == 0) {
+                checkState(system, model, ranges);
+            }
+        }
+        checkState(system, model, ranges);
+        withdrawAll(system, model);
+    }
+}
+
+// awardCoursePoints credits the roster of the moment. The system settles
+// lazily, when a student completes the course, withdraws, sees it removed
+// or merged away, which must not show in the points: the model credits
+// every student at once. Snapshots save the points owed as well.
+void testCourseBonus() {
+    part = "course bonus";
+    const char* const path = "system_test.snapshot";
+    for (int round = 0; round < 30; ++round) {
+        const Ranges ranges = randomRanges();
+        std::unique_ptr<TechSystem> system(new TechSystem());
+        Model model;
+        for (int step = 0; step < 4000; ++step) {
+            randomStep(*system, model, ranges, true);
+            if (step % 250 == 0) {
+                checkState(*system, model, ranges);
+            }
+            if (step % 1000 == 999) {
+                CHECK(system->saveSnapshot(path) == StatusType::SUCCESS);
+                system.reset(new TechSystem());
+                CHECK(system->loadSnapshot(path) == StatusType::SUCCESS);
+                checkState(*system, model, ranges);
+            }
+        }
+        checkState(*system, model, ranges);
+        // Settling everything left owed changes no points.
+        withdrawAll(*system, model);
+        for (const auto& course : model.courses) {
+            CHECK(system->removeCourse(course.first) == StatusType::SUCCESS);
+        }
+        checkState(*system, Model(), ranges);
+    }
+    std::remove(path);
+}
+
+// Every leaderboard query against the sorted model: the top of the board
+// at several lengths, and thresholds at ties, between points, above the
+// maximum and at the ends of int, each with capacities short of the
+// answer, exact and to spare.
+void checkLeaders(TechSystem& system, const Model& model) {
+    std::vector<std::pair<int, int>> board; // Minus the points, then the id.
+    for (const auto& student : model.students) {
+        board.emplace_back(-student.second, student.first);
+    }
+    std::sort(board.begin(), board.end());
+    const int size = int(board.size());
+    std::vector<int> ids(size + 4);
+    std::vector<int> points(size + 4);
+    // Whether the first count entries written are the top of the board.
+    const auto listed = [&](const int count) {
+        for (int i = 0; i < std::min(count, size); ++i) {
+            if (ids[i] != board[i].second || points[i] != -board[i].first) {
+                return false;
+            }
+        }
+        return true;
+    };
+
+    for (const int count : {0, 1, size / 2, size, size + 3}) {
+        output_t<int> top = system.getTopStudents(count, ids.data(), points.data());
+        CHECK(top.status() == StatusType::SUCCESS);
+        CHECK(top.ans() == std::min(count, size));
+        CHECK(listed(top.ans()));
+    }
+
+    std::vector<int> thresholds = {INT_MIN, INT_MAX, 0, 1};
+    if (size > 0) {
+        thresholds.push_back(-board.front().first + 1);
+        thresholds.push_back(-board.back().first);
+        for (int i = 0; i < 4; ++i) {
+            const int points = -board[pick(0, size - 1)].first;
+            thresholds.push_back(points);
+            thresholds.push_back(points + 1);
+        }
+    }
+    for (const int minPoints : thresholds) {
+        int qualified = 0;
+        while (qualified < size && -board[qualified].first >= minPoints) {
+            ++qualified;
+        }
+        output_t<int> count = system.countStudentsWithPoints(minPoints);
+        CHECK(count.status() == StatusType::SUCCESS);
+        CHECK(count.ans() == qualified);
+        for (const int capacity : {0, qualified / 2, qualified, qualified + 3}) {
+            output_t<int> found = system.getStudentsWithPoints(minPoints, ids.data(),
+                                                               points.data(), capacity);
+            CHECK(found.status() == StatusType::SUCCESS);
+            CHECK(found.ans() == std::min(capacity, qualified));
+            CHECK(listed(found.ans()));
+        }
+    }
+
+    CHECK(system.getTopStudents(-1, ids.data(), points.data()).status() ==
+          StatusType::INVALID_INPUT);
+    CHECK(system.getTopStudents(1, nullptr, points.data()).status() ==
+          StatusType::INVALID_INPUT);
+    CHECK(system.getStudentsWithPoints(0, ids.data(), nullptr, 1).status() ==
+          StatusType::INVALID_INPUT);
+    CHECK(system.getStudentsWithPoints(0, ids.data(), points.data(), -1).status() ==
+          StatusType::INVALID_INPUT);
+}
+
+// The leaderboard follows stored points, and course bonuses owed but not
+// settled place students by the bound on them. Every other round awards
+// course points, so both the exact walk and the bounded one are covered.
+// Points are small, so ties are common.
+void testLeaderboard() {
+    part = "leaderboard";
+    for (int round = 0; round < 40; ++round) {
+        const Ranges ranges = randomRanges();
+        TechSystem system;
+        Model model;
+        checkLeaders(system, model);
+        for (int step = 0; step < 2000; ++step) {
+            randomStep(system, model, ranges, round % 2 == 1);
+            if (step % 200 == 0) {
+                checkLeaders(system, model);
+            }
+        }
+        checkLeaders(system, model);
+    }
+}
+
+// applyBatch reorders the commands of a batch by id, but must give the
+// results and the state of running them in order.
+void testApplyBatch() {
+    part = "applyBatch";
+    for (int round = 0; round < 60; ++round) {
+        const Ranges ranges = randomRanges();
+        TechSystem batched;
+        TechSystem sequential;
+        Model model;
+        for (int batch = 0; batch < 40; ++batch) {
+            // One spare entry, so that an empty batch has valid arrays too.
+            const int count = pick(0, 120);
+            std::vector<TechSystem::Command> commands(count + 1);
+            for (TechSystem::Command& command : commands) {
+                command = randomCommand(ranges);
+            }
+            std::vector<TechSystem::CommandResult> results(count + 1);
+            CHECK(batched.applyBatch(commands.data(), count, results.data()) ==
+                  StatusType::SUCCESS);
+            for (int i = 0; i < count; ++i) {
+                const TechSystem::CommandResult one = sequential.apply(commands[i]);
+                CHECK(sameResult(one, model.apply(commands[i])));
+                CHECK(sameResult(results[i], one));
+            }
+        }
+        checkState(batched, model, ranges);
+        checkState(sequential, model, ranges);
+    }
+    TechSystem system;
+    TechSystem::CommandResult result;
+    CHECK(system.applyBatch(nullptr, 1, &result) == StatusType::INVALID_INPUT);
+    CHECK(system.applyBatch(nullptr, 0, &result) == StatusType::INVALID_INPUT);
+}
+
+// Systems of one process are independent: loading a snapshot, or failing
+// to, sets the state of the loading system only, bonus included.
+void testSnapshots() {
+    part = "snapshots";
+    const char* const path = "system_test.snapshot";
+    for (int round = 0; round < 20; ++round) {
+        const Ranges ranges = randomRanges();
+        TechSystem saved;
+        Model savedModel;
+        runCommands(saved, savedModel, ranges, 2000);
+        CHECK(saved.saveSnapshot(path, round) == StatusType::SUCCESS);
+
+        TechSystem other;
+        Model otherModel;
+        runCommands(other, otherModel, ranges, 2000);
+        TechSystem loaded;
+        long long position = -1;
+        CHECK(loaded.loadSnapshot(path, &position) == StatusType::SUCCESS);
+        CHECK(position == round);
+        Model loadedModel = savedModel;
+        checkState(saved, savedModel, ranges);
+        checkState(other, otherModel, ranges);
+        checkState(loaded, loadedModel, ranges);
+
+        // Only an empty system loads, and a refused load changes nothing.
+        if (!otherModel.students.empty() || !otherModel.courses.empty()) {
+            CHECK(other.loadSnapshot(path) == StatusType::FAILURE);
+        }
+        runCommands(saved, savedModel, ranges, 500);
+        runCommands(other, otherModel, ranges, 500);
+        runCommands(loaded, loadedModel, ranges, 500);
+        checkState(saved, savedModel, ranges);
+        checkState(other, otherModel, ranges);
+        checkState(loaded, loadedModel, ranges);
+    }
+
+    // A malformed file fails the load and leaves the system empty, with no
+    // bonus, even while another system has one.
+    TechSystem awarded;
+    CHECK(awarded.addStudent(1) == StatusType::SUCCESS);
+    CHECK(awarded.awardAcademicPoints(100) == StatusType::SUCCESS);
+    CHECK(awarded.saveSnapshot(path) == StatusType::SUCCESS);
+    std::FILE* const file = std::fopen(path, "r+b");
+    CHECK(file != nullptr);
+    if (file != nullptr) {
+        std::fseek(file, -1, SEEK_END);
+        std::fputc(~std::fgetc(file) & 0xff, file);
+        std::fclose(file);
+    }
+    TechSystem failed;
+    CHECK(failed.loadSnapshot(path) == StatusType::FAILURE);
+    CHECK(failed.addStudent(1) == StatusType::SUCCESS);
+    CHECK(failed.getStudentPoints(1).ans() == 0);
+    CHECK(awarded.getStudentPoints(1).ans() == 100);
+    std::remove(path);
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    rng.seed(argc > 1 ? unsigned(std::strtoul(argv[1], nullptr, 10)) : 2026u);
+    void (*const parts[])() = {testCommands, testWithdrawAndForcedRemove, testCourseBonus,
+                               testLeaderboard, testApplyBatch, testSnapshots};
+    for (void (*run)() : parts) {
+        const int before = failures;
+        run();
+        std::printf("%-24s %s\n", part, failures == before ? "ok" : "FAILED");
+    }
+    return failures == 0 ? 0 : 1;
+}
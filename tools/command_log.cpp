@@ -0,0 +1,513 @@
+// Converts command traces to the binary CommandLog format and replays them.
+//
+// Usage:
+//   command_log encode <trace.in> <trace.tscl>
+//       Convert a text trace, as read by main26a1.cpp, to a command log.
+//       Traces may also hold the commands main26a1.cpp does not read:
+//       withdrawStudent <student>, forceRemoveCourse <course> <0 or 1>,
+//       mergeCourses <source> <target> and awardCoursePoints <course> <points>.
+//   command_log replay <trace.tscl> <trace.tscr>
+//       Run a command log through a fresh TechSystem and write a result log.
+//       The time spent in TechSystem is reported on stderr.
+//   command_log print <trace.tscl> <trace.tscr>
+//       Print a command log and its result log as main26a1.cpp would have,
+//       for comparing with the .out file of the trace.
+//   command_log checkpoint <trace.tscl> <snapshot>
+//       Run a command log, save the final state as a snapshot and load it
+//       into a fresh TechSystem. Fails unless saving the loaded system gives
+//       the same bytes again. Save and load times are reported on stderr.
+//   command_log durable <trace.tscl> <snapshot> <wal> <policy>
+//       Run a command log through a WriteAheadLog with a checkpoint halfway,
+//       then recover a fresh TechSystem from the snapshot and the log. Fails
+//       unless it ends in the same state. policy is "op", "n=<N>" or
+//       "ms=<T>". Runs of addStudent or addCourse commands go through the
+//       bulk calls of the log, as a loader's would. Time per command and
+//       fsyncs are reported on stderr.
+//
+// Replay keeps the whole command log in memory and writes results through
+// a fixed buffer, so nothing is allocated per command.
+
+#include "CommandLog.h"
+#include "WriteAheadLog.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+const char* const COMMAND_NAMES[] = {
+    "addStudent",
+    "removeStudent",
+    "addCourse",
+    "removeCourse",
+    "enrollStudent",
+    "completeCourse",
+    "awardAcademicPoints",
+    "getStudentPoints",
+    "withdrawStudent",
+    "forceRemoveCourse",
+    "mergeCourses",
+    "awardCoursePoints"
+};
+
+const int COMMAND_COUNT = int(sizeof(COMMAND_NAMES) / sizeof(COMMAND_NAMES[0]));
+
+const char* const STATUS_NAMES[] = {
+    "SUCCESS",
+    "ALLOCATION_ERROR",
+    "INVALID_INPUT",
+    "FAILURE"
+};
+
+bool hasSecondArgument(const TechSystem::Opcode opcode) {
+    return opcode == TechSystem::Opcode::ADD_COURSE ||
+           opcode == TechSystem::Opcode::ENROLL_STUDENT ||
+           opcode == TechSystem::Opcode::COMPLETE_COURSE ||
+           opcode == TechSystem::Opcode::FORCE_REMOVE_COURSE ||
+           opcode == TechSystem::Opcode::MERGE_COURSES ||
+           opcode == TechSystem::Opcode::AWARD_COURSE_POINTS;
+}
+
+bool readFile(const char* path, std::vector<unsigned char>& data) {
+    std::FILE* file = std::fopen(path, "rb");
+    if (file == nullptr) {
+        std::fprintf(stderr, "cannot open %s\n", path);
+        return false;
+    }
+    unsigned char chunk[1 << 16];
+    size_t got;
+    while ((got = std::fread(chunk, 1, sizeof(chunk), file)) > 0) {
+        data.insert(data.end(), chunk, chunk + got);
+    }
+    std::fclose(file);
+    return true;
+}
+
+// Buffered binary output, flushed whenever fewer than reserve bytes are left.
+class Writer {
+public:
+    Writer() : file(nullptr), used(0) {}
+
+    Writer(const Writer&) = delete;
+    Writer& operator=(const Writer&) = delete;
+
+    ~Writer() {
+        close();
+    }
+
+    bool open(const char* path) {
+        file = std::fopen(path, "wb");
+        if (file == nullptr) {
+            std::fprintf(stderr, "cannot create %s\n", path);
+        }
+        return file != nullptr;
+    }
+
+    // Room for at least `reserve` more bytes, valid until advance().
+    unsigned char* room(const size_t reserve) {
+        if (used + reserve > sizeof(buffer)) {
+            flush();
+        }
+        return buffer + used;
+    }
+
+    void advance(const int length) {
+        used += size_t(length);
+    }
+
+    void close() {
+        if (file != nullptr) {
+            flush();
+            std::fclose(file);
+            file = nullptr;
+        }
+    }
+
+private:
+    std::FILE* file;
+    size_t used;
+    unsigned char buffer[1 << 16];
+
+    void flush() {
+        std::fwrite(buffer, 1, used, file);
+        used = 0;
+    }
+};
+
+int encode(const char* inputPath, const char* outputPath) {
+    std::ifstream in(inputPath);
+    if (!in) {
+        std::fprintf(stderr, "cannot open %s\n", inputPath);
+        return 1;
+    }
+    Writer out;
+    if (!out.open(outputPath)) {
+        return 1;
+    }
+    std::memcpy(out.room(CommandLog::MAGIC_SIZE), CommandLog::commandMagic(),
+                CommandLog::MAGIC_SIZE);
+    out.advance(CommandLog::MAGIC_SIZE);
+
+    CommandLog log;
+    std::string name;
+    long long line = 0;
+    while (in >> name) {
+        ++line;
+        TechSystem::Command command = {TechSystem::Opcode::ADD_STUDENT, 0, 0};
+        int opcode = 0;
+        while (opcode < COMMAND_COUNT && name != COMMAND_NAMES[opcode]) {
+            ++opcode;
+        }
+        if (opcode == COMMAND_COUNT) {
+            std::fprintf(stderr, "%s: command %lld: unknown command %s\n",
+                         inputPath, line, name.c_str());
+            return 1;
+        }
+        command.opcode = static_cast<TechSystem::Opcode>(opcode);
+        in >> command.first;
+        if (hasSecondArgument(command.opcode)) {
+            in >> command.second;
+        }
+        if (in.fail()) {
+            std::fprintf(stderr, "%s: command %lld: invalid input format\n",
+                         inputPath, line);
+            return 1;
+        }
+        out.advance(log.encode(command, out.room(CommandLog::MAX_COMMAND_SIZE)));
+    }
+    return 0;
+}
+
+int replay(const char* inputPath, const char* outputPath) {
+    std::vector<unsigned char> data;
+    if (!readFile(inputPath, data)) {
+        return 1;
+    }
+    const int size = int(data.size());
+    if (!CommandLog::hasMagic(data.data(), size, CommandLog::commandMagic())) {
+        std::fprintf(stderr, "%s: not a command log\n", inputPath);
+        return 1;
+    }
+    Writer out;
+    if (!out.open(outputPath)) {
+        return 1;
+    }
+    std::memcpy(out.room(CommandLog::MAGIC_SIZE), CommandLog::resultMagic(),
+                CommandLog::MAGIC_SIZE);
+    out.advance(CommandLog::MAGIC_SIZE);
+
+    TechSystem* system = new TechSystem();
+    CommandLog log;
+    TechSystem::Command command;
+    long long count = 0;
+    int offset = CommandLog::MAGIC_SIZE;
+    const Clock::time_point start = Clock::now();
+    while (offset < size) {
+        const int length = log.decode(data.data() + offset, size - offset, command);
+        if (length == 0) {
+            std::fprintf(stderr, "%s: corrupt record at byte %d\n", inputPath, offset);
+            delete system;
+            return 1;
+        }
+        offset += length;
+        const TechSystem::CommandResult result = system->apply(command);
+        out.advance(CommandLog::encodeResult(command.opcode, result,
+                                             out.room(CommandLog::MAX_RESULT_SIZE)));
+        ++count;
+    }
+    const double ns = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+    delete system;
+    std::fprintf(stderr, "replayed %lld commands, %.1f ns/command\n",
+                 count, count ? ns / double(count) : 0.0);
+    return 0;
+}
+
+int print(const char* commandPath, const char* resultPath) {
+    std::vector<unsigned char> commands;
+    std::vector<unsigned char> results;
+    if (!readFile(commandPath, commands) || !readFile(resultPath, results)) {
+        return 1;
+    }
+    const int commandSize = int(commands.size());
+    const int resultSize = int(results.size());
+    if (!CommandLog::hasMagic(commands.data(), commandSize, CommandLog::commandMagic()) ||
+        !CommandLog::hasMagic(results.data(), resultSize, CommandLog::resultMagic())) {
+        std::fprintf(stderr, "%s, %s: not a command log and a result log\n",
+                     commandPath, resultPath);
+        return 1;
+    }
+    CommandLog log;
+    TechSystem::Command command;
+    TechSystem::CommandResult result;
+    int commandOffset = CommandLog::MAGIC_SIZE;
+    int resultOffset = CommandLog::MAGIC_SIZE;
+    while (commandOffset < commandSize) {
+        const int commandLength = log.decode(commands.data() + commandOffset,
+                                             commandSize - commandOffset, command);
+        const int resultLength = commandLength == 0 ? 0 :
+            CommandLog::decodeResult(command.opcode, results.data() + resultOffset,
+                                     resultSize - resultOffset, result);
+        if (resultLength == 0) {
+            std::fprintf(stderr, "logs do not match at command byte %d\n", commandOffset);
+            return 1;
+        }
+        commandOffset += commandLength;
+        resultOffset += resultLength;
+        const char* name = COMMAND_NAMES[int(command.opcode)];
+        const char* status = STATUS_NAMES[int(result.status)];
+        if (command.opcode == TechSystem::Opcode::GET_STUDENT_POINTS &&
+            result.status == StatusType::SUCCESS) {
+            std::printf("%s: %s, %d\n", name, status, result.value);
+        } else {
+            std::printf("%s: %s\n", name, status);
+        }
+    }
+    if (resultOffset != resultSize) {
+        std::fprintf(stderr, "%s has results past the last command\n", resultPath);
+        return 1;
+    }
+    return 0;
+}
+
+// Run a command log through system, without keeping the results.
+bool run(const char* path, TechSystem& system, long long& count) {
+    std::vector<unsigned char> data;
+    if (!readFile(path, data)) {
+        return false;
+    }
+    const int size = int(data.size());
+    if (!CommandLog::hasMagic(data.data(), size, CommandLog::commandMagic())) {
+        std::fprintf(stderr, "%s: not a command log\n", path);
+        return false;
+    }
+    CommandLog log;
+    TechSystem::Command command;
+    int offset = CommandLog::MAGIC_SIZE;
+    while (offset < size) {
+        const int length = log.decode(data.data() + offset, size - offset, command);
+        if (length == 0) {
+            std::fprintf(stderr, "%s: corrupt record at byte %d\n", path, offset);
+            return false;
+        }
+        offset += length;
+        system.apply(command);
+        ++count;
+    }
+    return true;
+}
+
+double millisecondsSince(const Clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+int checkpoint(const char* inputPath, const char* snapshotPath) {
+    TechSystem* system = new TechSystem();
+    long long count = 0;
+    if (!run(inputPath, *system, count)) {
+        delete system;
+        return 1;
+    }
+    Clock::time_point start = Clock::now();
+    StatusType status = system->saveSnapshot(snapshotPath);
+    const double saveMs = millisecondsSince(start);
+    if (status != StatusType::SUCCESS) {
+        delete system;
+        std::fprintf(stderr, "cannot save %s\n", snapshotPath);
+        return 1;
+    }
+
+    // Loaded while the original is still alive, the two must not share state.
+    TechSystem* restored = new TechSystem();
+    start = Clock::now();
+    status = restored->loadSnapshot(snapshotPath);
+    const double loadMs = millisecondsSince(start);
+    const std::string checkPath = std::string(snapshotPath) + ".check";
+    if (status == StatusType::SUCCESS) {
+        status = restored->saveSnapshot(checkPath.c_str());
+    }
+    delete restored;
+    delete system;
+    std::vector<unsigned char> saved;
+    std::vector<unsigned char> resaved;
+    if (status != StatusType::SUCCESS || !readFile(snapshotPath, saved) ||
+        !readFile(checkPath.c_str(), resaved) || saved != resaved) {
+        std::fprintf(stderr, "%s does not load back to the same state\n", snapshotPath);
+        return 1;
+    }
+    std::remove(checkPath.c_str());
+    std::fprintf(stderr, "%lld commands, %zu byte snapshot, saved in %.2f ms, "
+                 "loaded in %.2f ms\n", count, saved.size(), saveMs, loadMs);
+    return 0;
+}
+
+bool parsePolicy(const char* text, WriteAheadLog::FlushPolicy& policy, int& every) {
+    every = 1;
+    if (std::strcmp(text, "op") == 0) {
+        policy = WriteAheadLog::FlushPolicy::EVERY_OPERATION;
+        return true;
+    }
+    if (std::strncmp(text, "n=", 2) == 0) {
+        policy = WriteAheadLog::FlushPolicy::EVERY_N_OPERATIONS;
+        every = std::atoi(text + 2);
+        return every > 0;
+    }
+    if (std::strncmp(text, "ms=", 3) == 0) {
+        policy = WriteAheadLog::FlushPolicy::EVERY_T_MILLISECONDS;
+        every = std::atoi(text + 3);
+        return every > 0;
+    }
+    std::fprintf(stderr, "unknown flush policy %s\n", text);
+    return false;
+}
+
+bool sameFiles(const char* first, const char* second) {
+    std::vector<unsigned char> firstData;
+    std::vector<unsigned char> secondData;
+    return readFile(first, firstData) && readFile(second, secondData) &&
+           firstData == secondData;
+}
+
+int durable(const char* inputPath, const char* snapshotPath, const char* logPath,
+            const char* policyText) {
+    WriteAheadLog::FlushPolicy policy;
+    int every;
+    if (!parsePolicy(policyText, policy, every)) {
+        return 1;
+    }
+    std::vector<unsigned char> data;
+    if (!readFile(inputPath, data)) {
+        return 1;
+    }
+    const int size = int(data.size());
+    if (!CommandLog::hasMagic(data.data(), size, CommandLog::commandMagic())) {
+        std::fprintf(stderr, "%s: not a command log\n", inputPath);
+        return 1;
+    }
+    std::vector<TechSystem::Command> commands;
+    CommandLog log;
+    TechSystem::Command command;
+    for (int offset = CommandLog::MAGIC_SIZE; offset < size;) {
+        const int length = log.decode(data.data() + offset, size - offset, command);
+        if (length == 0) {
+            std::fprintf(stderr, "%s: corrupt record at byte %d\n", inputPath, offset);
+            return 1;
+        }
+        offset += length;
+        commands.push_back(command);
+    }
+    std::remove(snapshotPath);
+    std::remove(logPath);
+    const std::string expectedPath = std::string(snapshotPath) + ".expected";
+    const std::string checkPath = std::string(snapshotPath) + ".check";
+
+    // The original run, checkpointed halfway and stopped without a final one.
+    TechSystem* system = new TechSystem();
+    WriteAheadLog* wal = new WriteAheadLog(policy, every);
+    bool success = wal->open(logPath, *system, 0) == StatusType::SUCCESS;
+    const Clock::time_point start = Clock::now();
+    const size_t half = commands.size() / 2;
+    std::vector<int> ids;
+    std::vector<int> points;
+    for (size_t i = 0; success && i < commands.size();) {
+        if (i == half) {
+            success = wal->checkpoint(*system, snapshotPath) == StatusType::SUCCESS;
+        }
+        // A run of adds of one kind, up to the checkpoint, in one bulk call.
+        // Should the bulk call fail, the commands run one by one.
+        const TechSystem::Opcode opcode = commands[i].opcode;
+        size_t end = i + 1;
+        if (opcode == TechSystem::Opcode::ADD_STUDENT ||
+            opcode == TechSystem::Opcode::ADD_COURSE) {
+            while (end < commands.size() && commands[end].opcode == opcode &&
+                   (i >= half || end < half)) {
+                ++end;
+            }
+        }
+        ids.clear();
+        points.clear();
+        for (size_t j = i; j < end; ++j) {
+            ids.push_back(commands[j].first);
+            points.push_back(commands[j].second);
+        }
+        StatusType bulk = StatusType::FAILURE;
+        if (end - i > 1 && opcode == TechSystem::Opcode::ADD_STUDENT) {
+            bulk = wal->addStudents(*system, ids.data(), int(ids.size()));
+        } else if (end - i > 1) {
+            bulk = wal->addCourses(*system, ids.data(), points.data(), int(ids.size()));
+        }
+        for (size_t j = i; bulk != StatusType::SUCCESS && j < end; ++j) {
+            wal->apply(*system, commands[j]);
+        }
+        i = end;
+    }
+    success = success && wal->commit();
+    const double ns = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+    const long long commits = wal->commits();
+    success = success &&
+              system->saveSnapshot(expectedPath.c_str(), wal->position()) == StatusType::SUCCESS;
+    delete wal;
+    delete system;
+    if (!success) {
+        std::fprintf(stderr, "cannot write %s or %s\n", snapshotPath, logPath);
+        return 1;
+    }
+
+    // Recovery, as after a crash.
+    system = new TechSystem();
+    wal = new WriteAheadLog(policy, every);
+    long long position = 0;
+    const Clock::time_point recoveryStart = Clock::now();
+    success = system->loadSnapshot(snapshotPath, &position) == StatusType::SUCCESS &&
+              wal->open(logPath, *system, position) == StatusType::SUCCESS;
+    const double recoveryMs = millisecondsSince(recoveryStart);
+    success = success &&
+              system->saveSnapshot(checkPath.c_str(), wal->position()) == StatusType::SUCCESS &&
+              sameFiles(expectedPath.c_str(), checkPath.c_str());
+    delete wal;
+    delete system;
+    if (!success) {
+        std::fprintf(stderr, "%s and %s do not recover the same state\n",
+                     snapshotPath, logPath);
+        return 1;
+    }
+    std::remove(expectedPath.c_str());
+    std::remove(checkPath.c_str());
+    std::fprintf(stderr, "%zu commands, %.1f us/command, %lld fsyncs, recovered in %.2f ms\n",
+                 commands.size(), commands.empty() ? 0.0 : ns / 1000.0 / double(commands.size()),
+                 commits, recoveryMs);
+    return 0;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    if (argc == 4 && std::strcmp(argv[1], "encode") == 0) {
+        return encode(argv[2], argv[3]);
+    }
+    if (argc == 4 && std::strcmp(argv[1], "replay") == 0) {
+        return replay(argv[2], argv[3]);
+    }
+    if (argc == 4 && std::strcmp(argv[1], "print") == 0) {
+        return print(argv[2], argv[3]);
+    }
+    if (argc == 4 && std::strcmp(argv[1], "checkpoint") == 0) {
+        return checkpoint(argv[2], argv[3]);
+    }
+    if (argc == 6 && std::strcmp(argv[1], "durable") == 0) {
+        return durable(argv[2], argv[3], argv[4], argv[5]);
+    }
+    std::fprintf(stderr,
+                 "usage: command_log encode <trace.in> <trace.tscl>\n"
+                 "       command_log replay <trace.tscl> <trace.tscr>\n"
+                 "       command_log print <trace.tscl> <trace.tscr>\n"
+                 "       command_log checkpoint <trace.tscl> <snapshot>\n"
+                 "       command_log durable <trace.tscl> <snapshot> <wal> <policy>\n");
+    return 2;
+}
@@ -0,0 +1,336 @@
+// Command-stream driver with the same output as main26a1.cpp, built for
+// throughput: the input is mapped (or read) in one piece, integers are
+// parsed by hand, commands are dispatched on a perfect hash of their name
+// and all output goes to one buffer that is written once at exit.
+//
+// Usage: fast_driver [input file]
+//   input file    defaults to standard input
+//
+// Malformed input is handled the way `cin >>` handles it in main26a1.cpp,
+// including the values a failed read leaves behind, so the output stays
+// byte-identical on any input.
+
+#include "TechSystem26a1.h"
+
+#include <climits>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+// The whole input as one read-only range.
+class Input {
+public:
+    Input() : data(nullptr), size(0), mapped(nullptr) {}
+
+    Input(const Input&) = delete;
+    Input& operator=(const Input&) = delete;
+
+    ~Input() {
+#ifndef _WIN32
+        if (mapped != nullptr) {
+            munmap(mapped, size);
+        }
+#endif
+    }
+
+    // Returns false if the input cannot be opened.
+    bool open(const char* path) {
+#ifndef _WIN32
+        const int fd = path ? ::open(path, O_RDONLY) : STDIN_FILENO;
+        if (fd < 0) {
+            return false;
+        }
+        struct stat info;
+        if (fstat(fd, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0) {
+            void* map = mmap(nullptr, size_t(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+            if (map != MAP_FAILED) {
+                madvise(map, size_t(info.st_size), MADV_SEQUENTIAL);
+                mapped = map;
+                data = static_cast<const char*>(map);
+                size = size_t(info.st_size);
+                if (path) {
+                    close(fd);
+                }
+                return true;
+            }
+        }
+        if (path) {
+            close(fd);
+        }
+#endif
+        // Pipes, empty files and platforms without mmap.
+        std::FILE* file = path ? std::fopen(path, "rb") : stdin;
+        if (file == nullptr) {
+            return false;
+        }
+        char chunk[1 << 16];
+        size_t got;
+        while ((got = std::fread(chunk, 1, sizeof(chunk), file)) > 0) {
+            owned.insert(owned.end(), chunk, chunk + got);
+        }
+        if (path) {
+            std::fclose(file);
+        }
+        data = owned.data();
+        size = owned.size();
+        return true;
+    }
+
+    const char* begin() const { return data; }
+    const char* end() const { return data + size; }
+
+private:
+    const char* data;
+    size_t size;
+    void* mapped;
+    std::vector<char> owned;
+};
+
+bool isSpace(const char c) {
+    return c == ' ' || c == '\n' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+}
+
+// Mirrors `in >> token` for a string: the next run of non-space bytes.
+bool readToken(const char*& pos, const char* end, const char*& token, size_t& length) {
+    while (pos < end && isSpace(*pos)) {
+        ++pos;
+    }
+    token = pos;
+    while (pos < end && !isSpace(*pos)) {
+        ++pos;
+    }
+    length = size_t(pos - token);
+    return length > 0;
+}
+
+// Mirrors `in >> value` for an int. On failure value is left alone at the
+// end of the input, set to 0 if no digits were read and to INT_MAX or
+// INT_MIN if they overflowed.
+bool readInt(const char*& pos, const char* end, int& value) {
+    while (pos < end && isSpace(*pos)) {
+        ++pos;
+    }
+    if (pos == end) {
+        return false;
+    }
+    bool negative = false;
+    if (pos < end && (*pos == '-' || *pos == '+')) {
+        negative = *pos == '-';
+        ++pos;
+    }
+    const unsigned long long limit = negative ? 1ULL + INT_MAX : INT_MAX;
+    unsigned long long magnitude = 0;
+    bool overflow = false;
+    const char* digits = pos;
+    while (pos < end && *pos >= '0' && *pos <= '9') {
+        if (!overflow) {
+            magnitude = magnitude * 10 + unsigned(*pos - '0');
+            overflow = magnitude > limit;
+        }
+        ++pos;
+    }
+    if (pos == digits) {
+        value = 0;
+        return false;
+    }
+    if (overflow) {
+        value = negative ? INT_MIN : INT_MAX;
+        return false;
+    }
+    value = negative ? int(-(long long)magnitude) : int(magnitude);
+    return true;
+}
+
+class Output {
+public:
+    explicit Output(const size_t expected) {
+        buffer.reserve(expected);
+    }
+
+    void put(const char* text, const size_t length) {
+        buffer.append(text, length);
+    }
+
+    void put(const char* text) {
+        buffer.append(text);
+    }
+
+    void put(const int value) {
+        char digits[12];
+        char* start = digits + sizeof(digits);
+        unsigned magnitude = value < 0 ? 0u - unsigned(value) : unsigned(value);
+        do {
+            *--start = char('0' + magnitude % 10);
+            magnitude /= 10;
+        } while (magnitude != 0);
+        if (value < 0) {
+            *--start = '-';
+        }
+        buffer.append(start, size_t(digits + sizeof(digits) - start));
+    }
+
+    void flush() {
+        std::fwrite(buffer.data(), 1, buffer.size(), stdout);
+        std::fflush(stdout);
+        buffer.clear();
+    }
+
+private:
+    std::string buffer;
+};
+
+const char* const STATUS_NAMES[] = {
+    "SUCCESS",
+    "ALLOCATION_ERROR",
+    "INVALID_INPUT",
+    "FAILURE"
+};
+
+void print(Output& out, const char* command, const size_t length, const StatusType status) {
+    out.put(command, length);
+    out.put(": ");
+    out.put(STATUS_NAMES[int(status)]);
+    out.put("\n", 1);
+}
+
+void print(Output& out, const char* command, const size_t length, output_t<int> result) {
+    out.put(command, length);
+    out.put(": ");
+    out.put(STATUS_NAMES[int(result.status())]);
+    if (result.status() == StatusType::SUCCESS) {
+        out.put(", ", 2);
+        out.put(result.ans());
+    }
+    out.put("\n", 1);
+}
+
+enum class Command {
+    ADD_STUDENT,
+    REMOVE_STUDENT,
+    ADD_COURSE,
+    REMOVE_COURSE,
+    ENROLL_STUDENT,
+    COMPLETE_COURSE,
+    AWARD_ACADEMIC_POINTS,
+    GET_STUDENT_POINTS,
+    UNKNOWN
+};
+
+struct CommandName {
+    const char* name;
+    Command command;
+};
+
+// (length + first byte) % 16 is distinct for the eight command names.
+const CommandName COMMAND_TABLE[16] = {
+    {nullptr, Command::UNKNOWN},
+    {"completeCourse", Command::COMPLETE_COURSE},           // 14 + 'c'
+    {"enrollStudent", Command::ENROLL_STUDENT},             // 13 + 'e'
+    {nullptr, Command::UNKNOWN},
+    {"awardAcademicPoints", Command::AWARD_ACADEMIC_POINTS}, // 19 + 'a'
+    {nullptr, Command::UNKNOWN},
+    {nullptr, Command::UNKNOWN},
+    {"getStudentPoints", Command::GET_STUDENT_POINTS},      // 16 + 'g'
+    {nullptr, Command::UNKNOWN},
+    {nullptr, Command::UNKNOWN},
+    {"addCourse", Command::ADD_COURSE},                     // 9 + 'a'
+    {"addStudent", Command::ADD_STUDENT},                   // 10 + 'a'
+    {nullptr, Command::UNKNOWN},
+    {nullptr, Command::UNKNOWN},
+    {"removeCourse", Command::REMOVE_COURSE},               // 12 + 'r'
+    {"removeStudent", Command::REMOVE_STUDENT},             // 13 + 'r'
+};
+
+Command lookup(const char* token, const size_t length) {
+    const CommandName& entry =
+        COMMAND_TABLE[(length + (unsigned char)token[0]) % 16];
+    if (entry.name != nullptr && std::strlen(entry.name) == length &&
+        std::memcmp(entry.name, token, length) == 0) {
+        return entry.command;
+    }
+    return Command::UNKNOWN;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    Input input;
+    if (!input.open(argc > 1 ? argv[1] : nullptr)) {
+        std::fprintf(stderr, "cannot open %s\n", argv[1]);
+        return 1;
+    }
+    const char* pos = input.begin();
+    const char* const end = input.end();
+    // Every output line is about as long as its input line.
+    Output out(size_t(end - pos) + (size_t(end - pos) >> 1));
+
+    TechSystem* obj = new TechSystem();
+
+    // Like main26a1.cpp, d1 and d2 keep their last value if not read again.
+    int d1 = 0;
+    int d2 = 0;
+    const char* token;
+    size_t length;
+    while (readToken(pos, end, token, length)) {
+        bool ok = true;
+        switch (lookup(token, length)) {
+            case Command::ADD_STUDENT:
+                ok = readInt(pos, end, d1);
+                print(out, token, length, obj->addStudent(d1));
+                break;
+            case Command::REMOVE_STUDENT:
+                ok = readInt(pos, end, d1);
+                print(out, token, length, obj->removeStudent(d1));
+                break;
+            case Command::ADD_COURSE:
+                ok = readInt(pos, end, d1) && readInt(pos, end, d2);
+                print(out, token, length, obj->addCourse(d1, d2));
+                break;
+            case Command::REMOVE_COURSE:
+                ok = readInt(pos, end, d1);
+                print(out, token, length, obj->removeCourse(d1));
+                break;
+            case Command::ENROLL_STUDENT:
+                ok = readInt(pos, end, d1) && readInt(pos, end, d2);
+                print(out, token, length, obj->enrollStudent(d1, d2));
+                break;
+            case Command::COMPLETE_COURSE:
+                ok = readInt(pos, end, d1) && readInt(pos, end, d2);
+                print(out, token, length, obj->completeCourse(d1, d2));
+                break;
+            case Command::AWARD_ACADEMIC_POINTS:
+                ok = readInt(pos, end, d1);
+                print(out, token, length, obj->awardAcademicPoints(d1));
+                break;
+            case Command::GET_STUDENT_POINTS:
+                ok = readInt(pos, end, d1);
+                print(out, token, length, obj->getStudentPoints(d1));
+                break;
+            case Command::UNKNOWN:
+                out.put("Unknown command: ");
+                out.put(token, length);
+                out.put("\n", 1);
+                out.flush();
+                return -1;
+        }
+        if (!ok) {
+            out.put("Invalid input format\n");
+            out.flush();
+            return -1;
+        }
+    }
+
+    out.flush();
+    delete obj;
+    return 0;
+}